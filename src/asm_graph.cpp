@@ -13,7 +13,9 @@
 #include "asm_proc.hpp"
 #include "thread.hpp"
 
-TLS worklist_t<asm_node_t*> asm_graph_t::worklist;
+TLS std::vector<asm_node_t*> asm_graph_t::dataflow_order;
+TLS std::vector<unsigned> asm_graph_t::dataflow_outputs_begin;
+TLS std::vector<unsigned> asm_graph_t::dataflow_outputs;
 
 ////////////////
 // asm_node_t //
@@ -582,6 +584,9 @@ std::vector<asm_node_t*> asm_graph_t::order()
 
     for(asm_node_t& node : list)
     {
+        // 'incoming' only depends on 'node', so it's built once, the first time it's needed.
+        bool built_incoming = false;
+
         auto const scale = [&](asm_node_t& other)
         {
             cfg_ht other_cfg = other.cfg;
@@ -591,9 +596,15 @@ std::vector<asm_node_t*> asm_graph_t::order()
                 return 1;
             assert(node.cfg && other_cfg);
 
-            incoming.clear();
-            if(node.cfg == other_cfg)
+            if(node.cfg != other_cfg)
+                return 1 << std::min<unsigned>(16, 2 * edge_depth(node.cfg, other_cfg));
+
+            if(!built_incoming)
+            {
+                incoming.clear();
                 build_incoming(incoming, node, node.cfg);
+                built_incoming = true;
+            }
 
             unsigned depth = 0;
 
@@ -638,6 +649,7 @@ std::vector<asm_node_t*> asm_graph_t::order()
         { return l.weight > r.weight; });
 
     // Build path cover greedily:
+    unsigned fallthrough_weight = 0;
     for(edge_t const& edge : elim_order)
     {
         asm_node_t& to = *edge.from->outputs()[edge.output].node;
@@ -653,6 +665,15 @@ std::vector<asm_node_t*> asm_graph_t::order()
         asm_node_t* end = &to;
         while(end->vcover.list_end)
             end = end->vcover.list_end;
+
+        // Point the nodes walked directly to the end, to keep later walks short:
+        for(asm_node_t* it = &to; it != end;)
+        {
+            asm_node_t* const next = it->vcover.list_end;
+            it->vcover.list_end = end;
+            it = next;
+        }
+
         if(end == edge.from)
             continue; // Cycle was found
 
@@ -661,6 +682,7 @@ std::vector<asm_node_t*> asm_graph_t::order()
         edge.from->vcover.path_output = edge.output;
         to.vcover.path_input = to.find_input(edge.from);
 
+        fallthrough_weight += edge.weight;
         dprint(log, "PATH_COVER_EDGE_MADE");
     }
 
@@ -684,7 +706,8 @@ std::vector<asm_node_t*> asm_graph_t::order()
         paths.push_back(std::move(path));
     }
 
-    dprint(log, "PATH_COVER_SIZE", paths.size());
+    // Each edge made into a fallthrough saves a jump or branch, weighted by its loop depth:
+    dprint(log, "PATH_COVER_SIZE", paths.size(), fallthrough_weight);
 
     ////////////////////////////////////////////////
     // Stop using 'vcover', start using 'vorder'. //
@@ -772,7 +795,7 @@ std::vector<asm_node_t*> asm_graph_t::order()
         }
     };
 
-    constexpr unsigned SOLVE_OPTIMALLY_LIMIT = 4;
+    constexpr unsigned SOLVE_OPTIMALLY_LIMIT = 6;
     if(paths.size() <= SOLVE_OPTIMALLY_LIMIT)
     {
         // For small sizes, we can solve the path order optimally:
@@ -814,6 +837,8 @@ std::vector<asm_node_t*> asm_graph_t::order()
     done:;
     }
 
+    dprint(log, "PATH_ORDER_COST", lowest_cost);
+
     // Now gather the final result:
     std::vector<asm_node_t*> result;
     result.reserve(list.size());
@@ -829,107 +854,145 @@ std::vector<asm_node_t*> asm_graph_t::order()
 // LIVENESS //
 //////////////
 
-template<typename Fn>
-void asm_graph_t::liveness_dataflow(Fn const& fn)
+// Liveness is solved by sweeping over the nodes in postorder until nothing changes.
+// Backward problems converge quickly in this order, as successors are visited first.
+// The order and each node's successors are stored in flat arrays,
+// letting the sweeps run over contiguous sets.
+
+// Numbers the nodes by postorder, storing the number in 'vid'.
+// Returns the number of nodes.
+std::size_t asm_graph_t::calc_dataflow_order()
 {
     for(asm_node_t& node : list)
-        node.clear_flags(FLAG_IN_WORKLIST | FLAG_PROCESSED);
+        node.clear_flags(FLAG_PROCESSED);
+
+    dataflow_order.clear();
 
-    worklist.clear();
+    // (This is iterative, as recursion could overflow the stack on large graphs.)
+    static TLS std::vector<std::pair<asm_node_t*, unsigned>> stack;
+    auto const visit = [&](asm_node_t& root)
+    {
+        if(root.test_flags(FLAG_PROCESSED))
+            return;
+
+        root.set_flags(FLAG_PROCESSED);
+        stack.push_back({ &root, 0 });
 
+        while(!stack.empty())
+        {
+            asm_node_t* const node = stack.back().first;
+            unsigned const i = stack.back().second++;
+
+            if(i < node->outputs().size())
+            {
+                asm_node_t& output = *node->outputs()[i].node;
+                if(!output.test_flags(FLAG_PROCESSED))
+                {
+                    output.set_flags(FLAG_PROCESSED);
+                    stack.push_back({ &output, 0 });
+                }
+            }
+            else
+            {
+                node->vid = dataflow_order.size();
+                dataflow_order.push_back(node);
+                stack.pop_back();
+            }
+        }
+    };
+
+    visit(*label_map[m_entry_label]);
+
+    // Some nodes might not be reachable from the entry. Handle those now:
     for(asm_node_t& node : list)
-        if(node.outputs().empty())
-            worklist.push(&node);
+        visit(node);
 
-    while(!worklist.empty())
+    assert(dataflow_order.size() == list.size());
+
+    dataflow_outputs.clear();
+    dataflow_outputs_begin.clear();
+    for(asm_node_t* node : dataflow_order)
     {
-    reenter:
-        asm_node_t& node = *worklist.pop();
+        node->clear_flags(FLAG_PROCESSED);
+        dataflow_outputs_begin.push_back(dataflow_outputs.size());
+        for(auto const& output : node->outputs())
+            dataflow_outputs.push_back(output.node->vid);
+    }
+    dataflow_outputs_begin.push_back(dataflow_outputs.size());
 
-        bool const changed = fn(node);
+    return dataflow_order.size();
+}
+
+// Solves backward dataflow problems like liveness, where for each node:
+//   out = the union of its successors' 'in' sets
+//   in  = GEN | (out & ~KILL)
+// Every node has sets of 'set_size' words, stored contiguously by 'vid'.
+// 'in' must hold GEN initially, and 'not_kill' holds the inverse of KILL.
+// Call 'calc_dataflow_order' first.
+template<typename UInt>
+void asm_graph_t::liveness_dataflow(std::size_t set_size, UInt const* not_kill, UInt* in, UInt* out)
+{
+    std::size_t const num_nodes = dataflow_order.size();
 
-        // Add all predecessors to worklist:
-        if(changed || !node.test_flags(FLAG_PROCESSED))
+    bool changed;
+    do
+    {
+        changed = false;
+
+        for(std::size_t i = 0; i < num_nodes; ++i)
         {
-            node.set_flags(FLAG_PROCESSED);
-            for(asm_node_t* input : node.inputs())
-                worklist.push(input);
+            UInt* const node_out = out + i * set_size;
+            bitset_clear_all(set_size, node_out);
+            for(unsigned j = dataflow_outputs_begin[i]; j < dataflow_outputs_begin[i+1]; ++j)
+                bitset_or(set_size, node_out, in + dataflow_outputs[j] * set_size);
+
+            UInt* const node_in = in + i * set_size;
+            UInt const* const node_not_kill = not_kill + i * set_size;
+            for(std::size_t k = 0; k < set_size; ++k)
+            {
+                UInt const new_in = node_in[k] | (node_out[k] & node_not_kill[k]);
+                changed |= new_in != node_in[k];
+                node_in[k] = new_in;
+            }
         }
     }
-
-    // Some nodes (infinite loops, etc) might not be reachable travelling
-    // backwards from the exit. Handle those now:
-    for(asm_node_t& node : list)
-        if(!node.test_flags(FLAG_PROCESSED))
-           worklist.push(&node);
-           
-    if(!worklist.empty())
-        goto reenter;
+    while(changed);
 }
 
 void asm_graph_t::optimize_live_registers()
 {
-    for(asm_node_t& node : list)
+    std::size_t const num_nodes = calc_dataflow_order();
+
+    static TLS std::vector<regs_t> reg_sets;
+    reg_sets.assign(num_nodes * 3, 0);
+    regs_t* const live_in = reg_sets.data();
+    regs_t* const live_out = live_in + num_nodes;
+    regs_t* const not_kill = live_out + num_nodes;
+
+    for(asm_node_t* node : dataflow_order)
     {
         regs_t gen = 0;
         regs_t kill = 0;
-        for(asm_inst_t const& inst : node.code)
+        for(asm_inst_t const& inst : node->code)
         {
             gen |= op_input_regs(inst.op) & ~kill;
             kill |= op_output_regs(inst.op);
         }
 
-        gen |= op_input_regs(node.output_inst.op) & ~kill;
-        kill |= op_output_regs(node.output_inst.op);
+        gen |= op_input_regs(node->output_inst.op) & ~kill;
+        kill |= op_output_regs(node->output_inst.op);
 
-        // Set 'vregs.in's initial value to be the set of variables used in
-        // this cfg node before an assignment.
-        // (This set is sometimes called 'GEN')
-        //
-        // Also set 'vregs.out' to temporarily hold all variables *NOT* defined
-        // in this node.
-        // (This set's inverse is sometimes called 'KILL')
-        node.vregs.in = gen;
-        node.vregs.out = ~kill;
+        live_in[node->vid] = gen;
+        not_kill[node->vid] = ~kill;
     }
 
-    liveness_dataflow([&](asm_node_t& node)
-    {
-        // Calculate the real live-out set, storing it in 'temp_set'.
-        // The live-out set is the union of the successor's live-in sets.
-        regs_t temp = 0;
-        for(auto const& output : node.outputs())
-            temp |= output.node->vregs.in;
-
-        // Now use that to calculate a new live-in set:
-        temp &= node.vregs.out; // vregs.out holds inverted KILL
-        temp |= node.vregs.in;
-
-        if(!node.test_flags(FLAG_PROCESSED) || temp != node.vregs.in)
-        {
-            node.set_flags(FLAG_PROCESSED);
-            for(asm_node_t* input : node.inputs())
-                worklist.push(input);
-        }
-
-        // If 'vlive.in' is changing:
-        bool const changing = temp != node.vregs.in;
-
-        // Assign 'vregs.in':
-        node.vregs.in = temp;
+    liveness_dataflow<regs_t>(1, not_kill, live_in, live_out);
 
-        return changing;
-    });
-
-    // Now properly set 'out' to be the union of all successor inputs:
-    for(asm_node_t& node : list)
+    for(asm_node_t* node : dataflow_order)
     {
-        // Might as well clear flags.
-        node.clear_flags(FLAG_IN_WORKLIST | FLAG_PROCESSED);
-
-        node.vregs.out = 0;
-        for(auto const& output : node.outputs())
-            node.vregs.out |= output.node->vregs.in;
+        unsigned const i = node->vid;
+        node->vregs.in = live_in[i];
+        node->vregs.out = live_out[i];
     }
 
     // OK! Register liveness has been calculated per-node.
@@ -1458,92 +1521,50 @@ unsigned asm_graph_t::calc_liveness(fn_t const& fn, rh::batman_set<locator_t> co
 {
     bitset_pool.clear();
     auto const bs_size = bitset_size<>(map.size());
+    std::size_t const num_nodes = calc_dataflow_order();
 
-    // Allocate bitsets:
-    for(asm_node_t& node : list)
-    {
-        node.vlive.in  = bitset_pool.alloc(bs_size);
-        node.vlive.out = bitset_pool.alloc(bs_size);
-        bitset_set_all(bs_size, node.vlive.out);
-    }
-
-    // Call this before 'do_write'.
-    auto const do_read = [](asm_node_t& node, unsigned i)
-    {
-        if(bitset_test(node.vlive.out, i))
-            bitset_set(node.vlive.in, i);
-    };
-
-    auto const do_write = [](asm_node_t& node, unsigned i)
-    { 
-        bitset_clear(node.vlive.out, i); 
-    };
+    // Allocate bitsets, contiguously:
+    bitset_uint_t* const live_in = bitset_pool.alloc(num_nodes * bs_size);
+    bitset_uint_t* const live_out = bitset_pool.alloc(num_nodes * bs_size);
+    bitset_uint_t* const not_kill = bitset_pool.alloc(num_nodes * bs_size);
+    bitset_set_all(num_nodes * bs_size, not_kill);
 
     // Every arg will be "written" at root:
-    asm_node_t& root = *label_map[m_entry_label];
+    bitset_uint_t* const root_in = live_in + label_map[m_entry_label]->vid * bs_size;
     for(locator_t const& loc : map)
     {
         if(loc.lclass() == LOC_ARG)
-            bitset_set(root.vlive.in, &loc - map.begin());
+            bitset_set(root_in, &loc - map.begin());
     }
 
-    for(asm_node_t& node : list)
+    for(asm_node_t* node : dataflow_order)
     {
-        // Set 'd.in's initial value to be the set of variables used in
-        // this cfg node before an assignment.
+        // Set 'in's initial value to be the set of variables used in
+        // this node before an assignment.
         // (This set is sometimes called 'GEN')
-        //
-        // Also set 'd.out' to temporarily hold all variables *NOT* defined
-        // in this node.
-        // (This set's inverse is sometimes called 'KILL')
+        bitset_uint_t* const node_in = live_in + node->vid * bs_size;
+        bitset_uint_t* const node_not_kill = not_kill + node->vid * bs_size;
 
-        for(asm_inst_t const& inst : node.code)
+        for(asm_inst_t const& inst : node->code)
         {
             do_inst_rw(fn, map, inst, [&](unsigned i, bool read, bool write)
             {
-                // Order matters here. 'do_write' comes after 'do_read'.
-                if(read)
-                    do_read(node, i); 
+                // Order matters here. Reads come before writes.
+                if(read && bitset_test(node_not_kill, i))
+                    bitset_set(node_in, i);
                 if(write)
-                    do_write(node, i); 
+                    bitset_clear(node_not_kill, i);
             });
         }
     }
 
-    // temp_set will hold a node's actual out-set while the algorithm is running.
-    auto* temp_set = ALLOCA_T(bitset_uint_t, bs_size);
-
-    liveness_dataflow([&](asm_node_t& node)
-    {
-        // Calculate the real live-out set, storing it in 'temp_set'.
-        // The live-out set is the union of the successor's live-in sets.
-        bitset_clear_all(bs_size, temp_set);
-        for(auto const& output : node.outputs())
-            bitset_or(bs_size, temp_set, output.node->vlive.in);
-
-        // Now use that to calculate a new live-in set:
-        bitset_and(bs_size, temp_set, node.vlive.out); // (vlive.out holds inverted KILL)
-        bitset_or(bs_size, temp_set, node.vlive.in);
+    liveness_dataflow(bs_size, not_kill, live_in, live_out);
 
-        // If 'vlive.in' is changing:
-        bool const changing = !bitset_eq(bs_size, temp_set, node.vlive.in);
-
-        // Assign 'vlive.in':
-        if(changing)
-            bitset_copy(bs_size, node.vlive.in, temp_set);
-
-        return changing;
-    });
-
-    // Now properly set 'out' to be the union of all successor inputs:
-    for(asm_node_t& node : list)
+    for(asm_node_t* node : dataflow_order)
     {
-        // Might as well clear flags.
-        node.clear_flags(FLAG_IN_WORKLIST | FLAG_PROCESSED);
-
-        bitset_clear_all(bs_size, node.vlive.out);
-        for(auto const& output : node.outputs())
-            bitset_or(bs_size, node.vlive.out, output.node->vlive.in);
+        unsigned const i = node->vid;
+        node->vlive.in = live_in + i * bs_size;
+        node->vlive.out = live_out + i * bs_size;
     }
 
     return bs_size;
@@ -1567,6 +1588,9 @@ lvars_manager_t asm_graph_t::build_lvars(fn_t const& fn)
         // Update the interference graph here:
         lvars.add_lvar_interferences(live);
 
+        // From here on, every variable in 'live' already interferes with the others,
+        // so only variables entering 'live' need new interferences.
+
         for(asm_inst_t& inst : node.code | std::views::reverse)
         {
             if((op_flags(inst.op) & ASMF_CALL) && inst.arg.lclass() == LOC_FN)
@@ -1576,10 +1600,6 @@ lvars_manager_t asm_graph_t::build_lvars(fn_t const& fn)
                 {
                     lvars.add_fn_interference(i, inst.arg.fn());
                 });
-
-                // Variables that are live together interfere with each other.
-                // Update the interference graph here:
-                lvars.add_lvar_interferences(live);
             }
 
             do_inst_rw(fn, lvars.map(), inst, [&](unsigned i, bool read, bool write)
@@ -1587,15 +1607,11 @@ lvars_manager_t asm_graph_t::build_lvars(fn_t const& fn)
                 // We have to set the value here temporarily,
                 // to ensure the interference will be marked.
                 // It usually gets cleared right after.
-                if(write)
-                    bitset_set(live, i);
-
-                if(read)
+                if((read || write) && !bitset_test(live, i))
+                {
                     bitset_set(live, i);
-
-                // Variables that are live together interfere with each other.
-                // Update the interference graph here:
-                lvars.add_lvar_interferences(live);
+                    lvars.add_lvar_interferences(i, live);
+                }
 
                 if(!read && write)
                     bitset_clear(live, i);
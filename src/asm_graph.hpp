@@ -145,8 +145,10 @@ private:
 
     unsigned calc_liveness(fn_t const& fn, rh::batman_set<locator_t> const& map);
 
-    template<typename Fn>
-    void liveness_dataflow(Fn const& fn);
+    std::size_t calc_dataflow_order();
+
+    template<typename UInt>
+    void liveness_dataflow(std::size_t set_size, UInt const* not_kill, UInt* in, UInt* out);
 
     array_pool_t<bitset_uint_t> bitset_pool;
     array_pool_t<asm_node_t> node_pool;
@@ -164,7 +166,10 @@ private:
 
     std::vector<delayed_lookup_t> to_lookup;
 
-    static TLS worklist_t<asm_node_t*> worklist;
+    // Nodes in postorder, and the 'vid' of each node's outputs (see 'calc_dataflow_order'):
+    static TLS std::vector<asm_node_t*> dataflow_order;
+    static TLS std::vector<unsigned> dataflow_outputs_begin;
+    static TLS std::vector<unsigned> dataflow_outputs;
 
     log_t* log;
 };
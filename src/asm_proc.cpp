@@ -1,5 +1,9 @@
 #include "asm_proc.hpp"
 
+#include <algorithm>
+#include <array>
+#include <tuple>
+
 #ifndef NDEBUG
 #include <iostream>
 #endif
@@ -25,6 +29,133 @@ bool mem_inst(asm_inst_t const& inst)
     return (op_input_regs(inst.op) | op_output_regs(inst.op)) & REGF_M;
 }
 
+namespace // anonymous
+{
+    // Where a peephole replacement gets its operand from.
+    enum peep_arg_t : std::uint8_t
+    {
+        PEEP_NONE,
+        PEEP_A, // The first matched instruction.
+        PEEP_B, // The second matched instruction.
+        PEEP_CONST,
+    };
+
+    struct peep_rule_t
+    {
+        op_t a;
+        std::int16_t a_const; // -1 if any operand matches.
+        op_t b;
+        std::int16_t b_const; // -1 if any operand matches.
+        bool same_arg;
+
+        struct
+        {
+            op_t op;
+            peep_arg_t arg;
+            std::uint8_t value; // For PEEP_CONST
+        } replace[2];
+    };
+
+    // Generated by 'peephole_gen.cpp', sorted by 'a', then 'b',
+    // with the most specific rules first.
+    constexpr peep_rule_t peep_rules[] =
+    {
+#define PEEP(a, ac, b, bc, same, r0, r0_arg, r0_value, r1, r1_arg, r1_value) \
+        { a, ac, b, bc, same, {{ r0, r0_arg, r0_value }, { r1, r1_arg, r1_value }} },
+#ifdef LEGAL
+#define PEEP_LEGAL(...) PEEP(__VA_ARGS__)
+#define PEEP_ILLEGAL(...)
+#else
+#define PEEP_LEGAL(...)
+#define PEEP_ILLEGAL(...) PEEP(__VA_ARGS__)
+#endif
+#include "peephole_rules.inc"
+#undef PEEP
+#undef PEEP_LEGAL
+#undef PEEP_ILLEGAL
+    };
+
+    constexpr unsigned num_peep_rules = sizeof(peep_rules) / sizeof(peep_rules[0]);
+
+    // Maps each op to the first rule matching it as 'a'.
+    constexpr auto peep_rules_begin = []
+    {
+        std::array<std::uint16_t, NUM_NORMAL_OPS + 1> ret = {};
+        unsigned rule = 0;
+        for(unsigned op = 0; op <= NUM_NORMAL_OPS; ++op)
+        {
+            while(rule < num_peep_rules && peep_rules[rule].a < op)
+                ++rule;
+            ret[op] = rule;
+        }
+        return ret;
+    }();
+
+    static_assert(num_peep_rules <= 0xFFFF);
+    static_assert(std::is_sorted(std::begin(peep_rules), std::end(peep_rules),
+        [](peep_rule_t const& l, peep_rule_t const& r) { return l.a < r.a || (l.a == r.a && l.b < r.b); }));
+} // end anonymous namespace
+
+// Applies the first rule of 'peep_rules' that matches 'a' followed by 'b'.
+static bool o_peephole_table(asm_inst_t& a, asm_inst_t& b)
+{
+    if(a.op >= NUM_NORMAL_OPS || b.op >= NUM_NORMAL_OPS)
+        return false;
+
+    peep_rule_t const* const rules_end = peep_rules + peep_rules_begin[a.op + 1];
+    peep_rule_t const* rule = std::lower_bound(peep_rules + peep_rules_begin[a.op], rules_end, b.op,
+        [](peep_rule_t const& rule, op_t op) { return rule.b < op; });
+
+    if(rule == rules_end || rule->b != b.op)
+        return false;
+
+    // Memory operands must be plain variables, as reads and writes get removed.
+    auto const mem_ok = [](asm_inst_t const& inst)
+    {
+        return !mem_inst(inst)
+            || (is_var_like(inst.arg.lclass()) && is_var_like(inst.alt.lclass(), true));
+    };
+
+    if(!mem_ok(a) || !mem_ok(b))
+        return false;
+
+    auto const const_ok = [](asm_inst_t const& inst, int value)
+    {
+        return value < 0 || (!inst.alt && inst.arg == locator_t::const_byte(value));
+    };
+
+    for(; rule != rules_end && rule->b == b.op; ++rule)
+    {
+        if(!const_ok(a, rule->a_const) || !const_ok(b, rule->b_const))
+            continue;
+
+        if(rule->same_arg && (a.arg != b.arg || a.alt != b.alt))
+            continue;
+
+        std::array<std::pair<locator_t, locator_t>, 2> args;
+        for(unsigned i = 0; i < 2; ++i)
+        {
+            auto const& r = rule->replace[i];
+            switch(r.arg)
+            {
+            case PEEP_NONE:  args[i] = {}; break;
+            case PEEP_A:     args[i] = { a.arg, a.alt }; break;
+            case PEEP_B:     args[i] = { b.arg, b.alt }; break;
+            case PEEP_CONST: args[i] = { locator_t::const_byte(r.value), {} }; break;
+            }
+        }
+
+        a.op = rule->replace[0].op;
+        std::tie(a.arg, a.alt) = args[0];
+        b.op = rule->replace[1].op;
+        std::tie(b.arg, b.alt) = args[1];
+
+        return true;
+    }
+
+    return false;
+}
+
 bool o_peephole(asm_inst_t* begin, asm_inst_t* end)
 {
     bool changed = false;
@@ -320,6 +451,13 @@ bool o_peephole(asm_inst_t* begin, asm_inst_t* end)
             }
             break;
         }
+
+        // Finally, try the generated rules:
+        if(o_peephole_table(a, b))
+        {
+            changed = true;
+            goto retry;
+        }
     });
 
     return changed;
@@ -408,6 +546,34 @@ void asm_proc_t::push_inst(asm_inst_t inst)
     code.push_back(inst);
 }
 
+std::vector<unsigned> asm_proc_t::loop_depths() const
+{
+    std::vector<int> delta(code.size() + 1, 0);
+
+    for(unsigned i = 0; i < code.size(); ++i)
+    {
+        asm_inst_t const& inst = code[i];
+
+        if(!(op_flags(inst.op) & (ASMF_BRANCH | ASMF_JUMP)) || !is_label(inst.arg.lclass()))
+            continue;
+
+        if(auto const* label = lookup_label(inst.arg))
+        {
+            if(label->index <= i)
+            {
+                delta[label->index] += 1;
+                delta[i + 1] -= 1;
+            }
+        }
+    }
+
+    std::vector<unsigned> depths(code.size());
+    int depth = 0;
+    for(unsigned i = 0; i < code.size(); ++i)
+        depths[i] = depth += delta[i];
+    return depths;
+}
+
 void asm_proc_t::absolute_to_zp()
 {
     for(asm_inst_t& inst : code)
@@ -160,6 +160,10 @@ struct asm_proc_t
 
     std::size_t size() const { return bytes_between(0, code.size()); }
 
+    // Returns the number of loops each instruction is inside of,
+    // treating every branch or jump to an earlier label as a loop.
+    std::vector<unsigned> loop_depths() const;
+
     loc_vec_t loc_vec() const;
     void write_assembly(std::ostream& os, romv_t romv) const;
     void write_bytes(std::uint8_t* const start, romv_t romv, int bank) const;
@@ -527,7 +527,7 @@ std::size_t code_gen(log_t* log, ir_t& ir, fn_t& fn)
     }
 
     // Then reserve extra space:
-    unsigned reserved_size = ssa_pool::array_size() + reserve;
+    unsigned reserved_size = ssa_pool::array_size_after(reserve);
     ssa_data_pool::resize<ssa_cg_d>(reserved_size);
 
     ////////////////
@@ -3325,7 +3325,7 @@ namespace isel
 
         case SSA_mul:
         case SSA_mul8_lo:
-            p_arg<2>::set(locator_t::runtime_rom(RTROM_mul8));
+            p_arg<2>::set(locator_t::runtime_rom(state.fn->mul_table() ? RTROM_mul8_table : RTROM_mul8));
 
             commutative(h, [&]()
             {
@@ -5183,599 +5183,720 @@ std::size_t select_instructions(log_t* log, fn_t& fn, ir_t& ir)
     build_loops_and_order(ir);
     build_dominators_from_order(ir);
 
-    _data_vec.clear();
-    _data_vec.resize(cfg_pool::array_size());
-
-    ///////////////////////////
-    // GENERATE PREPREP LIST //
-    ///////////////////////////
-
-    for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
+    auto const gen_load = [&](cross_cpu_t const& cross, regs_t reg, locator_t loc) -> asm_inst_t
     {
-        auto& d = data(cfg);
-        auto const& schedule = cg_data(cfg).schedule;
-
-        d.prep.resize(schedule.size());
+        if(loc.lclass() == LOC_SSA || loc.lclass() == LOC_PHI)
+            loc = asm_arg(loc.ssa_node());
 
-        for(int i = 0; i < int(schedule.size()); ++i)
+        switch(reg)
         {
-            prep_flags_t const flags = isel_node_build_preprep(schedule[i]);
-            assert((flags & PREPREP_FLAGS) == flags);
-
-            for(int j = i-1; j >= 0; --j)
-            {
-                if(ssa_input0_class(schedule[j]->op()) != INPUT_LINK)
-                {
-                    d.prep[j] |= flags;
-                    break;
-                }
-            }
-
-            d.prep[i] |= isel_node_build_postprep(schedule[i]);
-        }
-
-        assert(d.prep.empty() || (d.prep.back() & PREPREP_FLAGS) == 0);
+        case REG_A:
+            if(cross.defs[REG_X] == loc)
+                return { .op = TXA_IMPLIED, .ssa_op = SSA_gen_load };
+            else if(cross.defs[REG_Y] == loc)
+                return { .op = TYA_IMPLIED, .ssa_op = SSA_gen_load };
+            else if(loc.is_immediate())
+                return { .op = LDA_IMMEDIATE, .ssa_op = SSA_gen_load, .arg = loc };
+            else
+                return { .op = LDA_ABSOLUTE, .ssa_op = SSA_gen_load, .arg = loc };
 
-        // Also prepare memoized map here:
-        d.memoized_input_maps.resize(cfg->input_size());
-    }
+        case REG_X:
+            if(cross.defs[REG_A] == loc)
+                return { .op = TAX_IMPLIED, .ssa_op = SSA_gen_load };
+            else if(loc.is_immediate())
+                return { .op = LDX_IMMEDIATE, .ssa_op = SSA_gen_load, .arg = loc };
+            else
+                return { .op = LDX_ABSOLUTE, .ssa_op = SSA_gen_load, .arg = loc };
 
-    ///////////////////////////////////////////////
-    // GENERATE SELECTION LIST FOR EACH CFG NODE //
-    ///////////////////////////////////////////////
+        case REG_Y:
+            if(cross.defs[REG_A] == loc)
+                return { .op = TAY_IMPLIED, .ssa_op = SSA_gen_load };
+            else if(loc.is_immediate())
+                return { .op = LDY_IMMEDIATE, .ssa_op = SSA_gen_load, .arg = loc };
+            else
+                return { .op = LDY_ABSOLUTE, .ssa_op = SSA_gen_load, .arg = loc };
 
-    static TLS rh::batman_map<cross_transition_t, result_t> rebuilt;
-    static TLS std::vector<rh::apair<cross_cpu_t, isel_cost_t>> new_out_states;
+        case REG_C:
+            passert(!loc || loc.lclass() == LOC_CONST_BYTE, loc);
+            return { .op = loc.data() ? SEC_IMPLIED : CLC_IMPLIED, .ssa_op = SSA_gen_load };
 
-    bool const sloppy = fn.sloppy();
-    unsigned const BASE_SEL_SIZE = sloppy ? 2 : 32;
-    unsigned const BASE_MAP_SIZE = sloppy ? 4 : 128;
-    auto const SELS_COST_BOUND = sloppy ? cost_fn(NOP_IMPLIED) / 2 : cost_fn(LDA_ABSOLUTE) * 2;
+        default:
+            return { .op = ASM_PRUNED, .ssa_op = SSA_gen_load };
+        }
+    };
 
-    auto const shrink_sels = [&](cfg_ht cfg)
+    // Returns the cost of loading registers along a CFG edge,
+    // going from 'out' of the input node to 'in' of the output node.
+    auto const edge_load_cost = [&](cross_cpu_t const& in, cross_cpu_t const& out, cfg_ht output, unsigned input_i) -> pbqp_cost_t
     {
-        auto& d = data(cfg);
+        cross_cpu_t const loads = cross_loads(in, out, output, input_i);
 
-        unsigned max_sels = std::min<unsigned>(1 + loop_depth(cfg), 4) * BASE_SEL_SIZE;
+        pbqp_cost_t cost = 0;
 
-        if(d.sels.size() > max_sels)
+        for(regs_t reg = 0; reg < NUM_CROSS_REGS; ++reg)
         {
-            // Reuse 'rebuilt':
-            rebuilt.clear();
-            rebuilt.reserve(max_sels);
-
-            state.indices.resize(d.sels.size());
+            if(!loads.defs[reg])
+                continue;
 
-            auto const begin = state.indices.begin();
-            auto end = state.indices.end();
-            
-            auto comp = [&](unsigned a, unsigned b)
-                { return d.sels.begin()[a].second.cost > d.sels.begin()[b].second.cost; };
+            op_t const op = gen_load(loads, reg, LOC_NONE).op;
+            unsigned add_to_cost = cost_fn(op);
+            assert(add_to_cost);
 
-            std::iota(begin, end, 0);
-            std::make_heap(begin, end, comp);
+            // Make it arbitrarily worse than a normal load.
+            // (2 seems to be too small)
+            cost += add_to_cost * 3;
+        }
 
-            for(unsigned i = 0; i < max_sels; ++i)
-            {
-                std::pop_heap(begin, end, comp);
-                auto const& to_insert = d.sels.begin()[*(--end)];
+        return cost;
+    };
 
-                rebuilt.insert(to_insert);
-            }
+    // When an instruction selection budget is set, selection runs in multiple passes,
+    // starting with a narrow beam and widening it while budget remains.
+    // The cheapest selection found by a completed pass is kept.
+    // Each pass scales the default beam sizes by a power of 2, given by these shifts:
+    constexpr int ANYTIME_BEAM_SHIFTS[] = { 4, 2, 0, -1 };
 
-            d.sels.swap(rebuilt);
-        }
-    };
+    // The budget counts selections generated, rather than time, to keep the output deterministic.
+    bool const anytime = compiler_options().isel_budget > 0 && !fn.sloppy();
+    unsigned const num_passes = anytime ? std::size(ANYTIME_BEAM_SHIFTS) : 1;
+    std::uint64_t const budget = std::uint64_t(compiler_options().isel_budget) * 1000;
+    std::uint64_t work = 0;
 
-    // Create the initial worklist:
-    assert(cfg_worklist.empty());
-    for(cfg_ht cfg : postorder | std::views::reverse)
-    {
-        assert(!cfg->test_flags(FLAG_IN_WORKLIST));
-        cfg_worklist.push(cfg);
-    }
+    static TLS std::vector<rh::apair<cross_transition_t, result_t>> best_sels;
+    isel_cost_t best_total_cost = ~isel_cost_t(0);
 
-    // Setup initial 'in_state's:
-    for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
-    {
-        auto& d = data(cfg);
-        d.in_states.insert({});
-        d.to_compute.push_back(0);
-    }
+    // Repairs modify the IR, so they're tracked per pass:
+    std::vector<ssa_ht> pass_repairs;
+    std::vector<ssa_ht> best_repairs;
 
-    // Run until completion:
-    while(!cfg_worklist.empty())
+    for(unsigned pass = 0; pass < num_passes; ++pass)
     {
-        cfg_ht const cfg = cfg_worklist.pop();
-        auto& d = data(cfg);
-        d.iter += 1;
+        // Later passes only start while budget remains:
+        if(pass > 0 && work >= budget)
+            break;
 
-        if(d.to_compute.empty())
-            continue;
+        // Each pass starts from the original IR, undoing the repairs of the previous pass:
+        for(ssa_ht h : pass_repairs)
+            h->unsafe_set_op(SSA_cg_read_array8_direct);
+        pass_repairs.clear();
+        bool abandoned = false;
 
-        state.cfg_node = cfg;
-        setup_rolling_window(cfg);
-        unsigned repairs = 0;
-    do_selections:
-        dprint(state.log, "-ISEL_CFG", cfg);
-
-        // Init the state:
-        state.sel_pool.clear();
-        state.best_cost = ~0 - cost_cutoff(0);
-        state.map.clear();
-        for(unsigned index : d.to_compute)
+        int const beam_shift = (anytime ? ANYTIME_BEAM_SHIFTS[pass] : 0) - heat_isel_widen(fn.heat());
+        auto const scale_beam = [beam_shift](unsigned size) -> unsigned
         {
-#ifndef NDEBUG
-            for(locator_t loc : d.in_states.begin()[index].defs)
-                if(loc.lclass() == LOC_SSA)
-                    assert(loc.ssa_node()->cfg_node() != cfg);
-#endif
-            state.map.insert({ 
-                d.in_states.begin()[index].to_cpu(),
-                &state.sel_pool.emplace(nullptr,
-                    asm_inst_t{ .op = ASM_PRUNED, .arg = locator_t::index(index) }) });
-        }
+            if(beam_shift < 0)
+                return size << -beam_shift;
+            return std::max<unsigned>(size >> beam_shift, 2);
+        };
 
-        state.max_map_size = std::min<unsigned>(1 + loop_depth(cfg), 4) * BASE_MAP_SIZE;
+        dprint(state.log, "-ISEL_PASS", pass, beam_shift);
 
-        // Shrink the map size for large CFG nodes:
-        if(cfg->ssa_size() > 64)
-        {
-            state.max_map_size *= 64;
-            state.max_map_size /= cfg->ssa_size();
-            state.max_map_size = std::max<unsigned>(BASE_MAP_SIZE / 2, state.max_map_size);
-        }
+        _data_vec.clear();
+        _data_vec.resize(cfg_pool::array_size());
 
-        // Modes get stack instructions:
-        if(cfg == ir.root && state.fn->fclass == FN_MODE)
+        ///////////////////////////
+        // GENERATE PREPREP LIST //
+        ///////////////////////////
+
+        for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
         {
-            using Opt = options<>;
-            select_step<false>(
-                chain
-                < load_X<Opt, const_<0xFF>>
-                , simple_op<Opt, TXS_IMPLIED>
-                >);
-        }
+            auto& d = data(cfg);
+            auto const& schedule = cg_data(cfg).schedule;
 
-        assert(state.map.size() > 0);
+            d.prep.resize(schedule.size());
 
-        // Generate every selection:
-        auto const& schedule = cg_data(cfg).schedule;
-        for(unsigned i = 0; i < schedule.size(); ++i)
-        {
-            ssa_ht h = schedule[i];
-            try
+            for(int i = 0; i < int(schedule.size()); ++i)
             {
-#ifndef NDEBUG
-                state.selecting = false;
-#endif
-                state.ssa_node = h;
-                
-                if(d.prep[i] & PREPREP_FLAGS)
+                prep_flags_t const flags = isel_node_build_preprep(schedule[i]);
+                assert((flags & PREPREP_FLAGS) == flags);
+
+                for(int j = i-1; j >= 0; --j)
                 {
-                    select_step<false>([&](cpu_t const& cpu, sel_pair_t prev, cons_t const* cont)
+                    if(ssa_input0_class(schedule[j]->op()) != INPUT_LINK)
                     {
-                        cont->call(cpu, prev);
-
-                        if(d.prep[i] & PREPREP_A_0)
-                            load_A<options<>::restrict_to<~(REGF_X | REGF_Y)>, const_<0>>(cpu, prev, cont);
-
-                        if(d.prep[i] & PREPREP_X_0)
-                            load_X<options<>::restrict_to<~(REGF_A | REGF_Y)>, const_<0>>(cpu, prev, cont);
-
-                        if(d.prep[i] & PREPREP_Y_0)
-                            load_Y<options<>::restrict_to<~(REGF_A | REGF_X)>, const_<0>>(cpu, prev, cont);
-                    });
+                        d.prep[j] |= flags;
+                        break;
+                    }
                 }
 
-                isel_node(h); // This creates all the selections.
+                d.prep[i] |= isel_node_build_postprep(schedule[i]);
+            }
 
-                if(d.prep[i] & POSTPREP_FLAGS)
-                {
-                    auto v = ssa_to_value(h);
+            assert(d.prep.empty() || (d.prep.back() & PREPREP_FLAGS) == 0);
 
-                    select_step<false>([&](cpu_t const& cpu, sel_pair_t prev, cons_t const* cont)
-                    {
-                        cont->call(cpu, prev);
+            // Also prepare memoized map here:
+            d.memoized_input_maps.resize(cfg->input_size());
+        }
 
-                        p_def::set(h);
+        ///////////////////////////////////////////////
+        // GENERATE SELECTION LIST FOR EACH CFG NODE //
+        ///////////////////////////////////////////////
 
-                        if((d.prep[i] & POSTPREP_TAX) && cpu.value_eq(REG_A, v))
-                            exact_op<options<>, TAX_IMPLIED, p_def>(cpu, prev, cont);
+        static TLS rh::batman_map<cross_transition_t, result_t> rebuilt;
+        static TLS std::vector<rh::apair<cross_cpu_t, isel_cost_t>> new_out_states;
 
-                        if((d.prep[i] & POSTPREP_TAY) && cpu.value_eq(REG_A, v))
-                            exact_op<options<>, TAY_IMPLIED, p_def>(cpu, prev, cont);
+        bool const sloppy = fn.sloppy();
+        unsigned const BASE_SEL_SIZE = sloppy ? 2 : scale_beam(32);
+        unsigned const BASE_MAP_SIZE = sloppy ? 4 : scale_beam(128);
+        auto const SELS_COST_BOUND = sloppy ? cost_fn(NOP_IMPLIED) / 2 : cost_fn(LDA_ABSOLUTE) * 2;
 
-                        if((d.prep[i] & POSTPREP_TXA) && cpu.value_eq(REG_X, v))
-                            exact_op<options<>, TXA_IMPLIED, p_def>(cpu, prev, cont);
+        auto const shrink_sels = [&](cfg_ht cfg)
+        {
+            auto& d = data(cfg);
 
-                        if((d.prep[i] & POSTPREP_TYA) && cpu.value_eq(REG_Y, v))
-                            exact_op<options<>, TYA_IMPLIED, p_def>(cpu, prev, cont);
-                    });
-                }
-            }
-            catch(isel_no_progress_error_t const&)
+            unsigned max_sels = std::min<unsigned>(1 + loop_depth(cfg), 4) * BASE_SEL_SIZE;
+
+            if(d.sels.size() > max_sels)
             {
-                dprint(state.log, "-ISEL_NO_PROGRESS!");
+                // Reuse 'rebuilt':
+                rebuilt.clear();
+                rebuilt.reserve(max_sels);
 
-                // We'll try and fix the error.
+                state.indices.resize(d.sels.size());
 
-                ++repairs;
-                bool repaired = false;
-                constexpr unsigned REPAIR_LIMIT = 8;
+                auto const begin = state.indices.begin();
+                auto end = state.indices.end();
+            
+                auto comp = [&](unsigned a, unsigned b)
+                    { return d.sels.begin()[a].second.cost > d.sels.begin()[b].second.cost; };
 
-                if(repairs < REPAIR_LIMIT)
-                {
-                    // Maybe the addressing mode was impossible,
-                    // so let's make it simpler.
-                    for_each_node_input(h, [&](ssa_ht input)
-                    {
-                        if(input->cfg_node() == cfg && input->op() == SSA_cg_read_array8_direct)
-                        {
-                            input->unsafe_set_op(SSA_read_array8);
-                            repaired = true;
-                        }
-                    });
-                }
-                else if(repairs == REPAIR_LIMIT)
+                std::iota(begin, end, 0);
+                std::make_heap(begin, end, comp);
+
+                for(unsigned i = 0; i < max_sels; ++i)
                 {
-                    for(ssa_node_t& node : *cfg)
-                        if(node.op() == SSA_cg_read_array8_direct)
-                            node.unsafe_set_op(SSA_read_array8);
-                    repaired = true;
+                    std::pop_heap(begin, end, comp);
+                    auto const& to_insert = d.sels.begin()[*(--end)];
+
+                    rebuilt.insert(to_insert);
                 }
 
-                if(repaired)
-                    goto do_selections;
-                throw;
+                d.sels.swap(rebuilt);
             }
-            catch(...) { throw; }
+        };
+
+        // Create the initial worklist:
+        assert(cfg_worklist.empty());
+        for(cfg_ht cfg : postorder | std::views::reverse)
+        {
+            assert(!cfg->test_flags(FLAG_IN_WORKLIST));
+            cfg_worklist.push(cfg);
         }
 
-        // Clear after computing:
-        d.to_compute.clear();
+        // Setup initial 'in_state's:
+        for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
+        {
+            auto& d = data(cfg);
+            d.in_states.insert({});
+            d.to_compute.push_back(0);
+        }
 
-        // Assemble those selections:
-        assert(state.map.size());
-        new_out_states.clear();
-        unsigned const bound = SELS_COST_BOUND >> d.iter;
-        for(auto const& pair : state.map)
+        // Run until completion:
+        while(!cfg_worklist.empty())
         {
-            unsigned cost = pair.second.cost;
+            // Later passes are abandoned once the budget runs out:
+            if(pass > 0 && work >= budget)
+            {
+                dprint(state.log, "-ISEL_PASS_ABANDONED", pass);
+                cfg_worklist.clear();
+                abandoned = true;
+                break;
+            }
 
-            unsigned out_reg_count = 0;
-            for(unsigned i = 0; i < NUM_CROSS_REGS; ++i)
-                if(pair.first.defs[i])
-                    ++out_reg_count;
+            cfg_ht const cfg = cfg_worklist.pop();
+            auto& d = data(cfg);
+            d.iter += 1;
 
-            if(cost > d.min_sel_cost + bound + (cost_fn(STA_MAYBE) * out_reg_count))
+            if(d.to_compute.empty())
                 continue;
 
-            std::vector<asm_inst_t> code_temp;
-            sel_t const* first_sel = pair.second.sel;
+            state.cfg_node = cfg;
+            setup_rolling_window(cfg);
+            unsigned repairs = 0;
+        do_selections:
+            dprint(state.log, "-ISEL_CFG", cfg);
+
+            // Init the state:
+            state.sel_pool.clear();
+            state.best_cost = ~0 - cost_cutoff(0);
+            state.map.clear();
+            for(unsigned index : d.to_compute)
+            {
+    #ifndef NDEBUG
+                for(locator_t loc : d.in_states.begin()[index].defs)
+                    if(loc.lclass() == LOC_SSA)
+                        assert(loc.ssa_node()->cfg_node() != cfg);
+    #endif
+                state.map.insert({ 
+                    d.in_states.begin()[index].to_cpu(),
+                    &state.sel_pool.emplace(nullptr,
+                        asm_inst_t{ .op = ASM_PRUNED, .arg = locator_t::index(index) }) });
+            }
+
+            state.max_map_size = std::min<unsigned>(1 + loop_depth(cfg), 4) * BASE_MAP_SIZE;
 
-            // Create the 'code_temp' vector:
+            // Shrink the map size for large CFG nodes:
+            if(cfg->ssa_size() > 64)
             {
-                std::size_t size = 1;
-                assert(first_sel);
-                for(;first_sel->prev; first_sel = first_sel->prev)
-                    ++size;
-                code_temp.resize(size);
-                for(sel_t const* sel = pair.second.sel; sel; sel = sel->prev)
-                    code_temp[--size] = sel->inst;
-                assert(size == 0);
-                assert(code_temp[0].op == ASM_PRUNED);
-                code_temp[0] = { .op = ASM_LABEL, .arg = locator_t::cfg_label(cfg), };
+                state.max_map_size *= 64;
+                state.max_map_size /= cfg->ssa_size();
+                state.max_map_size = std::max<unsigned>(BASE_MAP_SIZE / 2, state.max_map_size);
             }
 
-            // For branches, determine if the carry varies per output.
-            std::array<carry_t, 2> carry_outputs = {};
-            if(cfg->output_size() == 2
-               && cfg->last_daisy() 
-               && !is_switch(cfg->last_daisy()->op()))
+            // Modes get stack instructions:
+            if(cfg == ir.root && state.fn->fclass == FN_MODE)
             {
-                std::array<cfg_ht, 2> const outputs = { cfg->output(0), cfg->output(1) };
+                using Opt = options<>;
+                select_step<false>(
+                    chain
+                    < load_X<Opt, const_<0xFF>>
+                    , simple_op<Opt, TXS_IMPLIED>
+                    >);
+            }
 
-                for(asm_inst_t& inst : code_temp)
+            assert(state.map.size() > 0);
+
+            // Generate every selection:
+            auto const& schedule = cg_data(cfg).schedule;
+            for(unsigned i = 0; i < schedule.size(); ++i)
+            {
+                ssa_ht h = schedule[i];
+                try
                 {
-                    if(inst.arg.lclass() == LOC_CFG_LABEL && (op_flags(inst.op) & (ASMF_JUMP | ASMF_BRANCH | ASMF_SWITCH)))
+    #ifndef NDEBUG
+                    state.selecting = false;
+    #endif
+                    state.ssa_node = h;
+                
+                    if(d.prep[i] & PREPREP_FLAGS)
                     {
-                        for(unsigned i = 0; i < 2; ++i)
+                        select_step<false>([&](cpu_t const& cpu, sel_pair_t prev, cons_t const* cont)
                         {
-                            if(inst.arg.cfg_node() != outputs[i])
-                                continue;
+                            cont->call(cpu, prev);
 
-                            if(inst.op == BCC_RELATIVE)
-                                carry_outputs[i] = carry_intersect(carry_outputs[i], CARRY_CLEAR); 
-                            else if(inst.op == BCS_RELATIVE)
-                                carry_outputs[i] = carry_intersect(carry_outputs[i], CARRY_SET); 
-                            else
-                                carry_outputs[i] = CARRY_TOP;
-                        }
+                            if(d.prep[i] & PREPREP_A_0)
+                                load_A<options<>::restrict_to<~(REGF_X | REGF_Y)>, const_<0>>(cpu, prev, cont);
+
+                            if(d.prep[i] & PREPREP_X_0)
+                                load_X<options<>::restrict_to<~(REGF_A | REGF_Y)>, const_<0>>(cpu, prev, cont);
+
+                            if(d.prep[i] & PREPREP_Y_0)
+                                load_Y<options<>::restrict_to<~(REGF_A | REGF_X)>, const_<0>>(cpu, prev, cont);
+                        });
                     }
-                }
-            }
 
-            // Determine the final 'start state'.
-            // This is the cpu state we started with, 
-            // ignoring any input register not actually used.
+                    isel_node(h); // This creates all the selections.
+
+                    if(d.prep[i] & POSTPREP_FLAGS)
+                    {
+                        auto v = ssa_to_value(h);
 
-            unsigned const in_i = first_sel->inst.arg.data();
-            assert(in_i < d.in_states.size());
+                        select_step<false>([&](cpu_t const& cpu, sel_pair_t prev, cons_t const* cont)
+                        {
+                            cont->call(cpu, prev);
 
-            cross_transition_t transition = 
-            { 
-                .in_state = d.in_states.begin()[in_i],
-                .out_state = cross_cpu_t(pair.first, carry_outputs[0], carry_outputs[1], true) 
-            };
+                            p_def::set(h);
 
-            regs_t gen = 0;
-            regs_t kill = 0;
-            for(asm_inst_t& inst : code_temp)
-            {
-                gen |= op_input_regs(inst.op) & ~kill;
-                kill |= op_output_regs(inst.op);
+                            if((d.prep[i] & POSTPREP_TAX) && cpu.value_eq(REG_A, v))
+                                exact_op<options<>, TAX_IMPLIED, p_def>(cpu, prev, cont);
+
+                            if((d.prep[i] & POSTPREP_TAY) && cpu.value_eq(REG_A, v))
+                                exact_op<options<>, TAY_IMPLIED, p_def>(cpu, prev, cont);
 
-                if(op_flags(inst.op) & ASMF_MAYBE_STORE)
+                            if((d.prep[i] & POSTPREP_TXA) && cpu.value_eq(REG_X, v))
+                                exact_op<options<>, TXA_IMPLIED, p_def>(cpu, prev, cont);
+
+                            if((d.prep[i] & POSTPREP_TYA) && cpu.value_eq(REG_Y, v))
+                                exact_op<options<>, TYA_IMPLIED, p_def>(cpu, prev, cont);
+                        });
+                    }
+                }
+                catch(isel_no_progress_error_t const&)
                 {
-                    // Reduce the cost of maybe stores when the register is output.
-                    if(cfg->output_size())
+                    dprint(state.log, "-ISEL_NO_PROGRESS!");
+
+                    // We'll try and fix the error.
+
+                    ++repairs;
+                    bool repaired = false;
+                    constexpr unsigned REPAIR_LIMIT = 8;
+
+                    if(repairs < REPAIR_LIMIT)
+                    {
+                        // Maybe the addressing mode was impossible,
+                        // so let's make it simpler.
+                        for_each_node_input(h, [&](ssa_ht input)
+                        {
+                            if(input->cfg_node() == cfg && input->op() == SSA_cg_read_array8_direct)
+                            {
+                                input->unsafe_set_op(SSA_read_array8);
+                                pass_repairs.push_back(input);
+                                repaired = true;
+                            }
+                        });
+                    }
+                    else if(repairs == REPAIR_LIMIT)
                     {
-                        for(unsigned i = 0; i < NUM_CROSS_REGS; ++i)
+                        for(ssa_node_t& node : *cfg)
                         {
-                            if((op_input_regs(inst.op) & (1 << i)) && inst.alt == transition.out_state.defs[i]) [[unlikely]]
+                            if(node.op() == SSA_cg_read_array8_direct)
                             {
-                                cost -= cost_fn(STA_MAYBE);
-                                break;
+                                node.unsafe_set_op(SSA_read_array8);
+                                pass_repairs.push_back(node.handle());
                             }
                         }
+                        repaired = true;
                     }
 
-                    inst.alt = LOC_NONE;
+                    if(repaired)
+                        goto do_selections;
+                    throw;
                 }
+                catch(...) { throw; }
             }
 
-            assert(first_sel->inst.op == ASM_PRUNED);
-            assert(first_sel->inst.arg.lclass() == LOC_INDEX);
+            // Clear after computing:
+            d.to_compute.clear();
+            work += state.sel_pool.size();
 
-#ifndef NDEBUG
-            for(locator_t loc : transition.in_state.defs)
-                if(loc.lclass() == LOC_SSA)
-                    assert(loc.ssa_node()->cfg_node() != cfg);
-#endif
-
-            for(unsigned i = 0; i < NUM_CROSS_REGS; ++i)
-                if(~gen & kill & (1 << i)) 
-                    transition.in_state.defs[i] = LOC_NONE;
-
-            // Some transitions have pass-through registers, 
-            // meaning they don't read or write those registers,
-            // they just pass their values along.
-            // For each pass-through register, 
-            // we'll also handle the case it's LOC_NONE,
-            // and will generate all the possible combinations:
+            // Assemble those selections:
+            assert(state.map.size());
+            new_out_states.clear();
+            unsigned const bound = SELS_COST_BOUND >> d.iter;
+            for(auto const& pair : state.map)
+            {
+                unsigned cost = pair.second.cost;
 
-            bc::small_vector<cross_transition_t, 8> sub_transitions;
-            sub_transitions.push_back(transition);
+                unsigned out_reg_count = 0;
+                for(unsigned i = 0; i < NUM_CROSS_REGS; ++i)
+                    if(pair.first.defs[i])
+                        ++out_reg_count;
 
-            for(unsigned i = 0; i < NUM_CROSS_REGS; ++i)
-            {
-                if((gen | kill) & (1 << i))
+                if(cost > d.min_sel_cost + bound + (cost_fn(STA_MAYBE) * out_reg_count))
                     continue;
 
-                if(!transition.in_state.defs[i] || transition.in_state.defs[i] != transition.out_state.defs[i])
-                    continue;
+                std::vector<asm_inst_t> code_temp;
+                sel_t const* first_sel = pair.second.sel;
 
-                // If the cfg node passes through a register,
-                // insert additional combinations:
-                unsigned const size = sub_transitions.size();
-                for(unsigned j = 0; j < size; ++j)
+                // Create the 'code_temp' vector:
                 {
-                    auto& t = sub_transitions.emplace_back(sub_transitions[j]);
-                    t.in_state.defs[i] = t.out_state.defs[i] = LOC_NONE;
+                    std::size_t size = 1;
+                    assert(first_sel);
+                    for(;first_sel->prev; first_sel = first_sel->prev)
+                        ++size;
+                    code_temp.resize(size);
+                    for(sel_t const* sel = pair.second.sel; sel; sel = sel->prev)
+                        code_temp[--size] = sel->inst;
+                    assert(size == 0);
+                    assert(code_temp[0].op == ASM_PRUNED);
+                    code_temp[0] = { .op = ASM_LABEL, .arg = locator_t::cfg_label(cfg), };
                 }
-            }
 
-            dprint(state.log, "ISEL_RESULT", cfg, cost);
+                // For branches, determine if the carry varies per output.
+                std::array<carry_t, 2> carry_outputs = {};
+                if(cfg->output_size() == 2
+                   && cfg->last_daisy() 
+                   && !is_switch(cfg->last_daisy()->op()))
+                {
+                    std::array<cfg_ht, 2> const outputs = { cfg->output(0), cfg->output(1) };
 
-            if(state.log)
-                for(auto const& inst : code_temp)
-                    dprint(state.log, inst);
+                    for(asm_inst_t& inst : code_temp)
+                    {
+                        if(inst.arg.lclass() == LOC_CFG_LABEL && (op_flags(inst.op) & (ASMF_JUMP | ASMF_BRANCH | ASMF_SWITCH)))
+                        {
+                            for(unsigned i = 0; i < 2; ++i)
+                            {
+                                if(inst.arg.cfg_node() != outputs[i])
+                                    continue;
 
-            dprint(state.log, "ISEL_RESULT_IN", transition.in_state);
-            dprint(state.log, "ISEL_RESULT_OUT", transition.out_state);
+                                if(inst.op == BCC_RELATIVE)
+                                    carry_outputs[i] = carry_intersect(carry_outputs[i], CARRY_CLEAR); 
+                                else if(inst.op == BCS_RELATIVE)
+                                    carry_outputs[i] = carry_intersect(carry_outputs[i], CARRY_SET); 
+                                else
+                                    carry_outputs[i] = CARRY_TOP;
+                            }
+                        }
+                    }
+                }
 
-            auto code_ptr = std::make_shared<std::vector<asm_inst_t>>(std::move(code_temp));
+                // Determine the final 'start state'.
+                // This is the cpu state we started with, 
+                // ignoring any input register not actually used.
 
-            assert(!sub_transitions.empty());
+                unsigned const in_i = first_sel->inst.arg.data();
+                assert(in_i < d.in_states.size());
 
-            for(unsigned i = 0; i < sub_transitions.size(); ++i)
-            {
-                rh::apair<cross_transition_t, result_t> new_sel = 
+                cross_transition_t transition = 
                 { 
-                    transition, 
-                    {
-                        .cost = cost + sub_transitions[i].heuristic_penalty(cfg->output_size()),
-                        .code = code_ptr
-                    }
+                    .in_state = d.in_states.begin()[in_i],
+                    .out_state = cross_cpu_t(pair.first, carry_outputs[0], carry_outputs[1], true) 
                 };
 
-                if(d.min_sel_cost > new_sel.second.cost)
-                    d.min_sel_cost = new_sel.second.cost;
-
-                // Insert the 'new_sel' into 'd':
-                auto insert_result = d.sels.insert(new_sel);
-                if(insert_result.second)
-                    new_out_states.push_back({ new_sel.first.out_state, new_sel.second.cost });
-                else
+                regs_t gen = 0;
+                regs_t kill = 0;
+                for(asm_inst_t& inst : code_temp)
                 {
-                    // Keep the lowest cost:
-                    if(insert_result.first->second.cost > new_sel.second.cost)
-                        insert_result.first->second = std::move(new_sel.second);
+                    gen |= op_input_regs(inst.op) & ~kill;
+                    kill |= op_output_regs(inst.op);
+
+                    if(op_flags(inst.op) & ASMF_MAYBE_STORE)
+                    {
+                        // Reduce the cost of maybe stores when the register is output.
+                        if(cfg->output_size())
+                        {
+                            for(unsigned i = 0; i < NUM_CROSS_REGS; ++i)
+                            {
+                                if((op_input_regs(inst.op) & (1 << i)) && inst.alt == transition.out_state.defs[i]) [[unlikely]]
+                                {
+                                    cost -= cost_fn(STA_MAYBE);
+                                    break;
+                                }
+                            }
+                        }
+
+                        inst.alt = LOC_NONE;
+                    }
                 }
 
-                dprint(state.log, "ISEL_RESULT_COST", insert_result.first->second.cost);
-                dprint(state.log, "ISEL_RESULT_INDEX", insert_result.first - d.sels.begin());
-            }
-        }
+                assert(first_sel->inst.op == ASM_PRUNED);
+                assert(first_sel->inst.arg.lclass() == LOC_INDEX);
 
-        // Pass our output CPU states to our output CFG nodes.
-        unsigned const output_size = cfg->output_size();
-        for(unsigned i = 0; i < output_size; ++i)
-        {
-            auto const oe = cfg->output_edge(i);
-            cfg_ht const output = oe.handle;
-            auto& od = data(output);
+    #ifndef NDEBUG
+                for(locator_t loc : transition.in_state.defs)
+                    if(loc.lclass() == LOC_SSA)
+                        assert(loc.ssa_node()->cfg_node() != cfg);
+    #endif
 
-            for(auto const& out_state : new_out_states)
-            {
-                if(out_state.second > d.min_sel_cost + bound)
-                    continue;
+                for(unsigned i = 0; i < NUM_CROSS_REGS; ++i)
+                    if(~gen & kill & (1 << i)) 
+                        transition.in_state.defs[i] = LOC_NONE;
+
+                // Some transitions have pass-through registers, 
+                // meaning they don't read or write those registers,
+                // they just pass their values along.
+                // For each pass-through register, 
+                // we'll also handle the case it's LOC_NONE,
+                // and will generate all the possible combinations:
+
+                bc::small_vector<cross_transition_t, 8> sub_transitions;
+                sub_transitions.push_back(transition);
 
-                auto cpus = cross_cpu_transitions(out_state.first, output, oe.index);
-                assert(!cpus.empty());
-                for(cross_cpu_t const& cpu : cpus)
+                for(unsigned i = 0; i < NUM_CROSS_REGS; ++i)
                 {
-                    auto result = od.in_states.insert(cpu);
-                    if(result.second)
+                    if((gen | kill) & (1 << i))
+                        continue;
+
+                    if(!transition.in_state.defs[i] || transition.in_state.defs[i] != transition.out_state.defs[i])
+                        continue;
+
+                    // If the cfg node passes through a register,
+                    // insert additional combinations:
+                    unsigned const size = sub_transitions.size();
+                    for(unsigned j = 0; j < size; ++j)
                     {
-                        od.to_compute.push_back(result.first - od.in_states.begin());
-                        cfg_worklist.push(output);
-                        assert(output->test_flags(FLAG_IN_WORKLIST));
+                        auto& t = sub_transitions.emplace_back(sub_transitions[j]);
+                        t.in_state.defs[i] = t.out_state.defs[i] = LOC_NONE;
                     }
-                    else
-                        assert(output->test_flags(FLAG_IN_WORKLIST) || od.sels.size() > 0);
                 }
-            }
-        }
-    }
 
-    for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
-        shrink_sels(cfg);
+                dprint(state.log, "ISEL_RESULT", cfg, cost);
 
-#ifndef NDEBUG
-    for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
-    {
-        auto& d = data(cfg);
-        passert(!cfg->test_flags(FLAG_IN_WORKLIST), cfg);
-        passert(d.sels.size() > 0, cfg, cfg->ssa_size());
-    }
-#endif
+                if(state.log)
+                    for(auto const& inst : code_temp)
+                        dprint(state.log, inst);
 
-    /////////////////////////////////////////
-    // PICK THE BEST SELECTION COMBINATION //
-    /////////////////////////////////////////
+                dprint(state.log, "ISEL_RESULT_IN", transition.in_state);
+                dprint(state.log, "ISEL_RESULT_OUT", transition.out_state);
 
-    auto const gen_load = [&](cross_cpu_t const& cross, regs_t reg, locator_t loc) -> asm_inst_t
-    {
-        if(loc.lclass() == LOC_SSA || loc.lclass() == LOC_PHI)
-            loc = asm_arg(loc.ssa_node());
+                auto code_ptr = std::make_shared<std::vector<asm_inst_t>>(std::move(code_temp));
 
-        switch(reg)
-        {
-        case REG_A:
-            if(cross.defs[REG_X] == loc)
-                return { .op = TXA_IMPLIED, .ssa_op = SSA_gen_load };
-            else if(cross.defs[REG_Y] == loc)
-                return { .op = TYA_IMPLIED, .ssa_op = SSA_gen_load };
-            else if(loc.is_immediate())
-                return { .op = LDA_IMMEDIATE, .ssa_op = SSA_gen_load, .arg = loc };
-            else
-                return { .op = LDA_ABSOLUTE, .ssa_op = SSA_gen_load, .arg = loc };
+                assert(!sub_transitions.empty());
 
-        case REG_X:
-            if(cross.defs[REG_A] == loc)
-                return { .op = TAX_IMPLIED, .ssa_op = SSA_gen_load };
-            else if(loc.is_immediate())
-                return { .op = LDX_IMMEDIATE, .ssa_op = SSA_gen_load, .arg = loc };
-            else
-                return { .op = LDX_ABSOLUTE, .ssa_op = SSA_gen_load, .arg = loc };
+                for(unsigned i = 0; i < sub_transitions.size(); ++i)
+                {
+                    rh::apair<cross_transition_t, result_t> new_sel = 
+                    { 
+                        transition, 
+                        {
+                            .cost = cost + sub_transitions[i].heuristic_penalty(cfg->output_size()),
+                            .code = code_ptr
+                        }
+                    };
 
-        case REG_Y:
-            if(cross.defs[REG_A] == loc)
-                return { .op = TAY_IMPLIED, .ssa_op = SSA_gen_load };
-            else if(loc.is_immediate())
-                return { .op = LDY_IMMEDIATE, .ssa_op = SSA_gen_load, .arg = loc };
-            else
-                return { .op = LDY_ABSOLUTE, .ssa_op = SSA_gen_load, .arg = loc };
+                    if(d.min_sel_cost > new_sel.second.cost)
+                        d.min_sel_cost = new_sel.second.cost;
 
-        case REG_C:
-            passert(!loc || loc.lclass() == LOC_CONST_BYTE, loc);
-            return { .op = loc.data() ? SEC_IMPLIED : CLC_IMPLIED, .ssa_op = SSA_gen_load };
+                    // Insert the 'new_sel' into 'd':
+                    auto insert_result = d.sels.insert(new_sel);
+                    if(insert_result.second)
+                        new_out_states.push_back({ new_sel.first.out_state, new_sel.second.cost });
+                    else
+                    {
+                        // Keep the lowest cost:
+                        if(insert_result.first->second.cost > new_sel.second.cost)
+                            insert_result.first->second = std::move(new_sel.second);
+                    }
 
-        default:
-            return { .op = ASM_PRUNED, .ssa_op = SSA_gen_load };
+                    dprint(state.log, "ISEL_RESULT_COST", insert_result.first->second.cost);
+                    dprint(state.log, "ISEL_RESULT_INDEX", insert_result.first - d.sels.begin());
+                }
+            }
+
+            // Pass our output CPU states to our output CFG nodes.
+            unsigned const output_size = cfg->output_size();
+            for(unsigned i = 0; i < output_size; ++i)
+            {
+                auto const oe = cfg->output_edge(i);
+                cfg_ht const output = oe.handle;
+                auto& od = data(output);
+
+                for(auto const& out_state : new_out_states)
+                {
+                    if(out_state.second > d.min_sel_cost + bound)
+                        continue;
+
+                    auto cpus = cross_cpu_transitions(out_state.first, output, oe.index);
+                    assert(!cpus.empty());
+                    for(cross_cpu_t const& cpu : cpus)
+                    {
+                        auto result = od.in_states.insert(cpu);
+                        if(result.second)
+                        {
+                            od.to_compute.push_back(result.first - od.in_states.begin());
+                            cfg_worklist.push(output);
+                            assert(output->test_flags(FLAG_IN_WORKLIST));
+                        }
+                        else
+                            assert(output->test_flags(FLAG_IN_WORKLIST) || od.sels.size() > 0);
+                    }
+                }
+            }
         }
-    };
 
-#ifndef NDEBUG
-    for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
-        assert(data(cfg).is_reset());
-#endif
+        if(abandoned)
+            break;
 
-    {
-        pbqp_t pbqp(state.log);
+        for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
+            shrink_sels(cfg);
 
+    #ifndef NDEBUG
         for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
         {
             auto& d = data(cfg);
-
-            isel_cost_t const multiplier = depth_exp(loop_depth(cfg));
-            assert(multiplier > 0);
-            assert(d.cost_vector.empty());
-
-            d.cost_vector.resize(d.sels.size(), 0);
-            for(unsigned i = 0; i < d.sels.size(); ++i)
-                d.cost_vector[i] = d.sels.begin()[i].second.cost * multiplier;
+            passert(!cfg->test_flags(FLAG_IN_WORKLIST), cfg);
+            passert(d.sels.size() > 0, cfg, cfg->ssa_size());
         }
+    #endif
 
+        /////////////////////////////////////////
+        // PICK THE BEST SELECTION COMBINATION //
+        /////////////////////////////////////////
+
+    #ifndef NDEBUG
         for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
+            assert(data(cfg).is_reset());
+    #endif
+
         {
-            auto& d = data(cfg);
+            pbqp_t pbqp(state.log);
 
-            unsigned const output_size = cfg->output_size();
-            for(unsigned i = 0; i < output_size; ++i)
+            for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
             {
-                auto const oe = cfg->output_edge(i);
-                auto& od = data(oe.handle);
+                auto& d = data(cfg);
+
+                isel_cost_t const multiplier = depth_exp(loop_depth(cfg));
+                assert(multiplier > 0);
+                assert(d.cost_vector.empty());
 
-                isel_cost_t const multiplier = depth_exp(edge_depth(cfg, oe.handle));
+                d.cost_vector.resize(d.sels.size(), 0);
+                for(unsigned i = 0; i < d.sels.size(); ++i)
+                    d.cost_vector[i] = d.sels.begin()[i].second.cost * multiplier;
+            }
+
+            for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
+            {
+                auto& d = data(cfg);
 
-                std::vector<pbqp_cost_t> cost_matrix(d.sels.size() * od.sels.size());
-                for(unsigned y = 0; y < od.sels.size(); ++y)
-                for(unsigned x = 0; x < d.sels.size(); ++x)
+                unsigned const output_size = cfg->output_size();
+                for(unsigned i = 0; i < output_size; ++i)
                 {
-                    cross_cpu_t const& in  = od.sels.begin()[y].first.in_state;
-                    cross_cpu_t const& out = d.sels.begin()[x].first.out_state;
-                    cross_cpu_t const loads = cross_loads(in, out, oe.handle, oe.index);
+                    auto const oe = cfg->output_edge(i);
+                    auto& od = data(oe.handle);
 
-                    pbqp_cost_t cost = 0;
+                    isel_cost_t const multiplier = depth_exp(edge_depth(cfg, oe.handle));
 
-                    for(regs_t reg = 0; reg < NUM_CROSS_REGS; ++reg)
+                    std::vector<pbqp_cost_t> cost_matrix(d.sels.size() * od.sels.size());
+                    for(unsigned y = 0; y < od.sels.size(); ++y)
+                    for(unsigned x = 0; x < d.sels.size(); ++x)
                     {
-                        if(!loads.defs[reg])
-                            continue;
+                        cross_cpu_t const& in  = od.sels.begin()[y].first.in_state;
+                        cross_cpu_t const& out = d.sels.begin()[x].first.out_state;
+                        cost_matrix[x + y * d.sels.size()] = edge_load_cost(in, out, oe.handle, oe.index) * multiplier;
+                    }
 
-                        op_t const op = gen_load(loads, reg, LOC_NONE).op;
-                        unsigned add_to_cost = cost_fn(op);
-                        assert(add_to_cost);
+                    pbqp.add_edge(d, od, std::move(cost_matrix));
+                }
+            }
 
-                        // Make it arbitrarily worse than a normal load.
-                        // (2 seems to be too small)
-                        cost += add_to_cost * 3;
-                    }
+            std::vector<pbqp_node_t*> pbqp_order;
+            for(cfg_ht cfg : postorder)
+                pbqp_order.push_back(&data(cfg));
+            pbqp.solve(std::move(pbqp_order));
+        }
 
-                    cost_matrix[x + y * d.sels.size()] = cost * multiplier;
+        if(anytime)
+        {
+            // Sum the cost of the solution, using the same weights the PBQP did:
+            isel_cost_t total_cost = 0;
+            for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
+            {
+                auto& d = data(cfg);
+                total_cost += d.final_cost() * depth_exp(loop_depth(cfg));
+
+                unsigned const output_size = cfg->output_size();
+                for(unsigned i = 0; i < output_size; ++i)
+                {
+                    auto const oe = cfg->output_edge(i);
+                    total_cost += (edge_load_cost(data(oe.handle).final_in_state(), d.final_out_state(), oe.handle, oe.index)
+                                   * depth_exp(edge_depth(cfg, oe.handle)));
                 }
+            }
 
-                pbqp.add_edge(d, od, std::move(cost_matrix));
+            dprint(state.log, "-ISEL_PASS_COST", pass, total_cost, best_total_cost);
+
+            if(total_cost < best_total_cost)
+            {
+                best_total_cost = total_cost;
+                best_sels.resize(cfg_pool::array_size());
+                for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
+                {
+                    auto const& d = data(cfg);
+                    best_sels[cfg.id] = d.sels.begin()[d.sel];
+                }
+                best_repairs = pass_repairs;
             }
         }
+    }
 
-        std::vector<pbqp_node_t*> pbqp_order;
-        for(cfg_ht cfg : postorder)
-            pbqp_order.push_back(&data(cfg));
-        pbqp.solve(std::move(pbqp_order));
+    if(anytime)
+    {
+        // Restore the IR to match the best selection:
+        for(ssa_ht h : pass_repairs)
+            h->unsafe_set_op(SSA_cg_read_array8_direct);
+        for(ssa_ht h : best_repairs)
+            h->unsafe_set_op(SSA_read_array8);
+
+        // Restore the best selection, leaving one selection per node:
+        assert(best_total_cost != ~isel_cost_t(0));
+        for(cfg_ht cfg = ir.cfg_begin(); cfg; ++cfg)
+        {
+            auto& d = data(cfg);
+            d.sels.clear();
+            d.sels.insert(std::move(best_sels[cfg.id]));
+            d.sel = 0;
+        }
+        best_sels.clear();
     }
 
     ///////////////////////////
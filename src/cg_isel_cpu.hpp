@@ -2,7 +2,10 @@
 #define CG_ISEL_CPU_HPP
 
 #include <array>
+#include <bit>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include "asm.hpp"
 #include "locator.hpp"
@@ -113,29 +116,48 @@ struct cpu_t
         return true;
     }
 
+    // cpu_t is laid out as 8 machine words: the six 'defs',
+    // then 'known', 'known_mask', and 'conditional_regs' packed together,
+    // then 'req_store'. Hashing and comparison operate on these words.
+    static constexpr unsigned NUM_WORDS = 8;
+    static constexpr unsigned KNOWN_WORD = NUM_ISEL_REGS;
+
+    // 'conditional_regs' shares a word with 'known'; this masks it out.
+    static constexpr std::uint64_t KNOWN_WORD_MASK = 
+        std::endian::native == std::endian::little 
+        ? ~(0xFFull << 56ull) : ~0xFFull;
+
+    std::array<std::uint64_t, NUM_WORDS> words() const
+    {
+        std::array<std::uint64_t, NUM_WORDS> ret;
+        std::memcpy(ret.data(), this, sizeof(ret));
+        ret[KNOWN_WORD] &= KNOWN_WORD_MASK;
+        return ret;
+    }
+
     // Determines if two cpus are reasonably equivalent.
     // Keep in sync with 'hash'.
     // DO NOT COMPARE 'conditional_regs'!
     bool operator==(cpu_t const& o) const 
     { 
         assert(known_array_valid() && o.known_array_valid());
-        return (req_store == o.req_store 
-                && defs == o.defs 
-                && known_mask == o.known_mask
-                && known == o.known);
+        auto const a = words();
+        auto const b = o.words();
+        std::uint64_t diff = 0;
+        for(unsigned i = 0; i < NUM_WORDS; ++i)
+            diff |= a[i] ^ b[i];
+        return diff == 0;
     }
 
     // Keep in sync with 'operator=='.
     // DO NOT HASH 'conditional_regs'!
     std::size_t hash() const
     {
-        std::size_t h = req_store;
-        for(locator_t const& v : defs)
-            h = rh::hash_combine(h, v.to_uint());
-        for(unsigned i = 0; i < known.size(); ++i)
-            h = rh::hash_combine(h, known[i]);
-        h = rh::hash_combine(h, known_mask);
-        return h;
+        auto const w = words();
+        std::uint64_t h = 0;
+        for(unsigned i = 0; i < NUM_WORDS; ++i)
+            h = (std::rotl(h, 23) ^ w[i]) * 0x9e3779b97f4a7c15ull;
+        return rh::hash_finalize(h);
     }
     
     // If we know the value of a register:
@@ -336,6 +358,13 @@ struct cpu_t
     }
 };
 
+static_assert(sizeof(locator_t) == sizeof(std::uint64_t));
+static_assert(offsetof(cpu_t, known) == cpu_t::KNOWN_WORD * sizeof(std::uint64_t));
+static_assert(offsetof(cpu_t, known_mask) == offsetof(cpu_t, known) + NUM_KNOWN_REGS);
+static_assert(offsetof(cpu_t, conditional_regs) == offsetof(cpu_t, known) + 7);
+static_assert(offsetof(cpu_t, req_store) == (cpu_t::KNOWN_WORD + 1) * sizeof(std::uint64_t));
+static_assert(sizeof(cpu_t) == cpu_t::NUM_WORDS * sizeof(std::uint64_t));
+
 // Like cpu_t, but tracks far, far less state.
 // This is used to pass CPU state across CFG boundaries.
 struct cross_cpu_t
@@ -11,6 +11,7 @@
 #include "mods.hpp"
 #include "globals.hpp"
 #include "text.hpp"
+#include "trace.hpp"
 
 namespace fs = ::std::filesystem;
 
@@ -94,6 +95,8 @@ conversion_t convert_file(char const* source, pstring_t script, fs::path preferr
 {
     using namespace std::literals;
 
+    trace_span_t const span("convert", filename.string);
+
     try
     {
         fs::path path;
@@ -1,10 +1,19 @@
 #include "convert_png.hpp"
 
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <cstring>
+#include <mutex>
+#include <ostream>
 #include <stdexcept>
 #include <cassert>
 
+#include "robin/hash.hpp"
+#include "robin/set.hpp"
+
 #include "format.hpp"
+#include "options.hpp"
 #include "lodepng/lodepng.h"
 
 std::uint8_t map_grey_alpha(std::uint8_t grey, std::uint8_t alpha)
@@ -12,6 +21,103 @@ std::uint8_t map_grey_alpha(std::uint8_t grey, std::uint8_t alpha)
     return (grey * (alpha + 1)) >> (6 + 8);
 }
 
+// Loads 8 pixels, with the leftmost pixel in the lowest byte.
+static std::uint64_t load_pixels(std::uint8_t const* pixels)
+{
+    std::uint64_t ret;
+    if constexpr(std::endian::native == std::endian::little)
+        std::memcpy(&ret, pixels, sizeof(ret));
+    else
+    {
+        ret = 0;
+        for(unsigned i = 0; i < 8; ++i)
+            ret |= std::uint64_t(pixels[i]) << (i * 8);
+    }
+    return ret;
+}
+
+// Gathers bit 'bit' of 8 pixels into one bitplane byte, with the leftmost pixel in the highest bit.
+// (The multiply moves each pixel's bit into the top byte, without any carries colliding.)
+static std::uint8_t pack_plane(std::uint64_t pixels, unsigned bit)
+{
+    constexpr std::uint64_t lsbs = 0x0101010101010101ull;
+    constexpr std::uint64_t gather = 0x8040201008040201ull;
+    return (((pixels >> bit) & lsbs) * gather) >> 56;
+}
+
+namespace // anonymous
+{
+    // An 8x8 CHR tile, with each bitplane packed into an integer.
+    struct chr_tile_t
+    {
+        std::uint64_t planes[2];
+
+        auto operator<=>(chr_tile_t const&) const = default;
+
+        chr_tile_t flip_h() const
+        {
+            chr_tile_t ret = *this;
+            for(std::uint64_t& p : ret.planes)
+            {
+                p = ((p >> 1) & 0x5555555555555555ull) | ((p & 0x5555555555555555ull) << 1);
+                p = ((p >> 2) & 0x3333333333333333ull) | ((p & 0x3333333333333333ull) << 2);
+                p = ((p >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((p & 0x0F0F0F0F0F0F0F0Full) << 4);
+            }
+            return ret;
+        }
+
+        chr_tile_t flip_v() const
+        {
+            chr_tile_t ret = *this;
+            for(std::uint64_t& p : ret.planes)
+            {
+                p = ((p >> 8)  & 0x00FF00FF00FF00FFull) | ((p & 0x00FF00FF00FF00FFull) << 8);
+                p = ((p >> 16) & 0x0000FFFF0000FFFFull) | ((p & 0x0000FFFF0000FFFFull) << 16);
+                p = (p >> 32) | (p << 32);
+            }
+            return ret;
+        }
+
+        // The same key for every flipped variant.
+        chr_tile_t canonical() const
+        {
+            chr_tile_t const h = flip_h();
+            return std::min({ *this, h, flip_v(), h.flip_v() });
+        }
+    };
+
+    struct chr_tile_hash_t
+    {
+        std::size_t operator()(chr_tile_t const& tile) const
+        {
+            return rh::hash_finalize(rh::hash_combine(tile.planes[0], tile.planes[1]));
+        }
+    };
+
+    // Indexes every tile converted from a PNG, to report how much CHR deduplication would save.
+    // (Conversions happen while parsing, which is threaded.)
+    struct chr_tile_index_t
+    {
+        std::mutex mutex;
+        std::size_t total = 0;
+        rh::batman_set<chr_tile_t, chr_tile_hash_t> unique;
+        rh::batman_set<chr_tile_t, chr_tile_hash_t> unique_flipped;
+
+        void insert(std::uint8_t const* chr, std::size_t size)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(std::size_t i = 0; i + 16 <= size; i += 16, ++total)
+            {
+                chr_tile_t const tile = { load_pixels(chr + i), load_pixels(chr + i + 8) };
+                unique.insert(tile);
+                unique_flipped.insert(tile.canonical());
+            }
+        }
+    };
+
+    chr_tile_index_t chr_tile_index;
+} // end anonymous namespace
+
 std::vector<std::uint8_t> png_to_chr(std::uint8_t const* png, std::size_t size, bool chr16)
 {
     unsigned width, height;
@@ -29,14 +135,17 @@ std::vector<std::uint8_t> png_to_chr(std::uint8_t const* png, std::size_t size,
     else if(!chr16 && height % 8 != 0)
         throw convert_error_t("Image height is not a multiple of 8.");
 
+    // Each pixel's 2-bit color starts at this bit,
+    // letting the bitplane packer skip a separate pass over the image.
+    unsigned color_bit;
+
     switch(state.info_png.color.colortype)
     {
     case LCT_PALETTE:
         state.info_raw.colortype = LCT_PALETTE;
         if((error = lodepng::decode(image, width, height, state, png, size)))
             goto fail;
-        for(std::uint8_t& c : image)
-            c &= 0b11;
+        color_bit = 0;
         break;
 
     case LCT_GREY:
@@ -44,8 +153,7 @@ std::vector<std::uint8_t> png_to_chr(std::uint8_t const* png, std::size_t size,
         state.info_raw.colortype = LCT_GREY;
         if((error = lodepng::decode(image, width, height, state, png, size)))
             goto fail;
-        for(std::uint8_t& c : image)
-            c >>= 6;
+        color_bit = 6;
         break;
 
     default:
@@ -57,6 +165,7 @@ std::vector<std::uint8_t> png_to_chr(std::uint8_t const* png, std::size_t size,
         for(unsigned i = 0; i < n; ++i)
             image[i] = map_grey_alpha(image[i*2], image[i*2 + 1]);
         image.resize(n);
+        color_bit = 0;
         break;
     }
 
@@ -65,49 +174,59 @@ std::vector<std::uint8_t> png_to_chr(std::uint8_t const* png, std::size_t size,
         std::vector<std::uint8_t> result;
         result.resize(image.size() / 4);
 
-        unsigned i = 0;
+        std::uint8_t* out = result.data();
+
+        // Converts the 8x8 tile at 'tx', 'ty', with each row producing one byte per plane.
+        auto const convert_tile = [&](unsigned tx, unsigned ty)
+        {
+            for(unsigned y = 0; y < 8; ++y)
+            {
+                std::uint64_t const pixels = load_pixels(&image[tx + (ty + y)*width]);
+                out[y]     = pack_plane(pixels, color_bit);
+                out[y + 8] = pack_plane(pixels, color_bit + 1);
+            }
+            out += 16;
+        };
 
         if(chr16)
         {
             for(unsigned ty = 0; ty < height; ty += 16)
             for(unsigned tx = 0; tx < width; tx += 8)
             {
-                for(unsigned y = 0; y < 8; ++y, ++i)
-                for(unsigned x = 0; x < 8; ++x)
-                    result[i] |= (image[tx + x + (ty + y)*width] & 1) << (7-x);
-
-                for(unsigned y = 0; y < 8; ++y, ++i)
-                for(unsigned x = 0; x < 8; ++x)
-                    result[i] |= (image[tx + x + (ty + y)*width] >> 1) << (7-x);
-
-                for(unsigned y = 8; y < 16; ++y, ++i)
-                for(unsigned x = 0; x < 8; ++x)
-                    result[i] |= (image[tx + x + (ty + y)*width] & 1) << (7-x);
-
-                for(unsigned y = 8; y < 16; ++y, ++i)
-                for(unsigned x = 0; x < 8; ++x)
-                    result[i] |= (image[tx + x + (ty + y)*width] >> 1) << (7-x);
+                convert_tile(tx, ty);
+                convert_tile(tx, ty + 8);
             }
         }
         else
         {
             for(unsigned ty = 0; ty < height; ty += 8)
             for(unsigned tx = 0; tx < width; tx += 8)
-            {
-                for(unsigned y = 0; y < 8; ++y, ++i)
-                for(unsigned x = 0; x < 8; ++x)
-                    result[i] |= (image[tx + x + (ty + y)*width] & 1) << (7-x);
-
-                for(unsigned y = 0; y < 8; ++y, ++i)
-                for(unsigned x = 0; x < 8; ++x)
-                    result[i] |= (image[tx + x + (ty + y)*width] >> 1) << (7-x);
-            }
+                convert_tile(tx, ty);
         }
 
-        assert(i == result.size());
+        assert(out == result.data() + result.size());
+
+        // Only needed for 'ROM_info.txt':
+        if(compiler_options().ram_info)
+            chr_tile_index.insert(result.data(), result.size());
 
         return result;
     }
 fail:
     throw convert_error_t(fmt("png decoder error: %", lodepng_error_text(error)));
 }
+
+void print_chr_tiles(std::ostream& o)
+{
+    std::lock_guard<std::mutex> lock(chr_tile_index.mutex);
+
+    std::size_t const total = chr_tile_index.total;
+    std::size_t const unique = chr_tile_index.unique.size();
+    std::size_t const unique_flipped = chr_tile_index.unique_flipped.size();
+
+    o << "CHR tiles converted from PNG files:\n\n";
+    o << fmt("  total: %\n", total);
+    o << fmt("  unique: % (% bytes are duplicates)\n", unique, (total - unique) * 16);
+    o << fmt("  unique when flipped: % (% bytes are duplicates; flipping only applies to sprites)\n\n", 
+             unique_flipped, (total - unique_flipped) * 16);
+}
@@ -2,10 +2,14 @@
 #define CONVERT_PNG_HPP
 
 #include <cstdint>
+#include <ostream>
 #include <vector>
 
 #include "convert.hpp"
 
 std::vector<std::uint8_t> png_to_chr(std::uint8_t const* png, std::size_t size, bool chr16);
 
+// Reports how many converted CHR tiles are duplicates, for 'ROM_info.txt'.
+void print_chr_tiles(std::ostream& o);
+
 #endif
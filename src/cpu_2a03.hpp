@@ -1,3 +1,5 @@
+// Included into the body of 'nsf_emulator_t' (puf.cpp), giving each instance its own CPU.
+
 //this code was initially made in 2006 as 6507 emulator
 //it is stripped down version without tracking timings etc
 
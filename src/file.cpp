@@ -1,11 +1,14 @@
 #include "file.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <stdexcept>
+#include <condition_variable>
 #include <deque>
 #include <mutex>
 
+#include "robin/map.hpp"
 #include "robin/set.hpp"
 
 #include "platform.hpp"
@@ -35,9 +38,19 @@ struct macro_result_t
 };
 
 static std::mutex invoke_mutex;
+static std::condition_variable parse_cv;
 static rh::batman_set<macro_invocation_t> invoke_set;
+static std::vector<std::pair<unsigned, macro_invocation_t>> invoke_edges;
 static std::deque<macro_result_t> macro_results;
-static std::deque<macro_result_t> new_macro_results;
+static std::vector<unsigned> macro_ranks;
+
+// Files waiting to be parsed, shared by the parse threads:
+static std::deque<unsigned> parse_queue;
+static unsigned parse_busy = 0;
+static bool parse_aborted = false;
+
+// The file the current thread is parsing.
+static thread_local unsigned parse_file_i = 0;
 
 void invoke_macro(macro_invocation_t invoke)
 {
@@ -60,27 +73,145 @@ void invoke_macro(
         throw std::runtime_error(fmt("Unknown macro: %", invoke.name));
 
     unsigned const file_i = (pair - compiler_options().macro_names.begin()) + compiler_options().num_fab;
+
+    // Skip repeated invocations before doing any expansion work.
+    // Every caller is recorded though, to order files in 'finalize_macros'.
+    {
+        std::lock_guard<std::mutex> lock(invoke_mutex);
+        invoke_edges.emplace_back(parse_file_i, invoke);
+        if(!invoke_set.insert(invoke).second)
+            return;
+    }
+
     std::string str = invoke_macro(file_i, invoke.args);
     str += append;
     str.push_back('\0');
 
     {
         std::lock_guard<std::mutex> lock(invoke_mutex);
-        if(invoke_set.insert(invoke).second)
+        parse_queue.push_back(macro_results.size() + compiler_options().source_names.size());
+        macro_results.push_back({ pair->second.dir / pair->second.file, std::move(invoke), std::move(str), 
+                                  std::move(private_globals), std::move(private_groups) });
+    }
+
+    // Hand the expansion to an idle parse thread right away:
+    parse_cv.notify_one();
+}
+
+void start_parse_files(unsigned num_files)
+{
+    std::lock_guard<std::mutex> lock(invoke_mutex);
+    for(unsigned i = 0; i < num_files; ++i)
+        parse_queue.push_back(i);
+}
+
+bool next_parse_file(unsigned& file_i)
+{
+    std::unique_lock<std::mutex> lock(invoke_mutex);
+
+    // Parsing is only done once the queue is empty and no thread
+    // is still parsing, as those threads may invoke more macros.
+    parse_cv.wait(lock, []{ return parse_aborted || !parse_queue.empty() || parse_busy == 0; });
+
+    if(parse_aborted || parse_queue.empty())
+        return false;
+
+    file_i = parse_queue.front();
+    parse_queue.pop_front();
+    ++parse_busy;
+    parse_file_i = file_i;
+    return true;
+}
+
+void finish_parse_file()
+{
+    std::lock_guard<std::mutex> lock(invoke_mutex);
+    passert(parse_busy > 0, parse_busy);
+    if(--parse_busy == 0)
+        parse_cv.notify_all();
+}
+
+void abort_parse_files()
+{
+    {
+        std::lock_guard<std::mutex> lock(invoke_mutex);
+        parse_aborted = true;
+    }
+    parse_cv.notify_all();
+}
+
+unsigned idle_parse_threads()
+{
+    std::lock_guard<std::mutex> lock(invoke_mutex);
+    unsigned const used = parse_busy + parse_queue.size();
+    unsigned const num_threads = compiler_options().num_threads;
+    return used < num_threads ? num_threads - used : 0;
+}
+
+void finalize_macros()
+{
+    // Macros were expanded in whatever order the parse threads ran,
+    // so their file indexes vary between runs.
+    // Rank them by nesting depth, then invocation, to get a stable order.
+    unsigned const num_sources = compiler_options().source_names.size();
+
+    rh::batman_map<macro_invocation_t, unsigned> result_map;
+    for(unsigned i = 0; i < macro_results.size(); ++i)
+        result_map.insert({ macro_results[i].invoke, i });
+
+    std::vector<std::vector<unsigned>> callees(num_sources + macro_results.size());
+    for(auto const& edge : invoke_edges)
+        callees[edge.first].push_back(*result_map.mapped(edge.second));
+
+    // Breadth-first, starting from the .fab files:
+    std::vector<unsigned> depth(macro_results.size(), ~0u);
+    std::vector<unsigned> next;
+    std::vector<unsigned> frontier;
+    for(unsigned i = 0; i < compiler_options().num_fab; ++i)
+        frontier.push_back(i);
+
+    for(unsigned d = 1; !frontier.empty(); ++d)
+    {
+        for(unsigned file_i : frontier)
         {
-            new_macro_results.push_back({ pair->second.dir / pair->second.file, std::move(invoke), std::move(str), 
-                                          std::move(private_globals), std::move(private_groups) });
+            for(unsigned callee : callees[file_i])
+            {
+                if(depth[callee] != ~0u)
+                    continue;
+                depth[callee] = d;
+                next.push_back(callee + num_sources);
+            }
         }
+
+        frontier.swap(next);
+        next.clear();
     }
+
+    std::vector<unsigned> order(macro_results.size());
+    for(unsigned i = 0; i < order.size(); ++i)
+        order[i] = i;
+
+    std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b)
+    {
+        if(depth[a] != depth[b])
+            return depth[a] < depth[b];
+        return macro_results[a].invoke < macro_results[b].invoke;
+    });
+
+    macro_ranks.resize(order.size());
+    for(unsigned i = 0; i < order.size(); ++i)
+        macro_ranks[order[i]] = i;
+
+    invoke_edges.clear();
 }
 
-std::pair<unsigned, unsigned> finalize_macros()
+unsigned stable_file_rank(unsigned file_i)
 {
-    unsigned const first = macro_results.size() + compiler_options().source_names.size();
-    macro_results.insert(macro_results.end(), new_macro_results.begin(), new_macro_results.end());
-    unsigned const second = macro_results.size() + compiler_options().source_names.size();
-    new_macro_results.clear();
-    return { first, second };
+    unsigned const num_sources = compiler_options().source_names.size();
+    if(file_i < num_sources)
+        return file_i;
+    passert(file_i - num_sources < macro_ranks.size(), file_i, macro_ranks.size());
+    return num_sources + macro_ranks[file_i - num_sources];
 }
 
 bool resource_path(fs::path preferred_dir, fs::path name, fs::path& result)
@@ -235,8 +366,12 @@ void file_contents_t::reset(unsigned file_i)
         // Load a macro-generated file:
 
         unsigned const index = file_i - compiler_options().source_names.size();
+
+        // Elements of a deque don't move, but parse threads may be appending to it.
+        std::unique_lock<std::mutex> lock(invoke_mutex);
         passert(index < macro_results.size(), index, macro_results.size());
         auto const& macro = macro_results[index];
+        lock.unlock();
 
         m_path = macro.path;
         m_size = macro.contents.size()+1;
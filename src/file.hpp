@@ -52,9 +52,24 @@ void invoke_macro(
     ident_map_t<group_ht> private_groups,
     std::string const& append = {});
 
-// Merges newly invoked macros into the file list.
-// Returns the range of new file indexes.
-std::pair<unsigned, unsigned> finalize_macros();
+// Parse threads pull file indexes from a shared queue.
+// Invoked macros are added to the queue as soon as they're expanded.
+void start_parse_files(unsigned num_files);
+// Blocks until a file is ready. Returns false once parsing is done.
+bool next_parse_file(unsigned& file_i);
+void finish_parse_file();
+// Wakes any waiting threads after an error.
+void abort_parse_files();
+// How many of the 'num_threads' threads aren't parsing, nor have a file waiting for them.
+// Work done while parsing a file can use this many extra threads.
+unsigned idle_parse_threads();
+
+// Call once parsing is done, before using 'stable_file_rank'.
+void finalize_macros();
+
+// File indexes of macros depend on thread timing.
+// This maps them to a value that doesn't.
+unsigned stable_file_rank(unsigned file_i);
 
 bool resource_path(fs::path preferred_dir, fs::path name, fs::path& result);
 bool read_binary_file(char const* filename, std::function<void*(std::size_t)> const& alloc);
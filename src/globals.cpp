@@ -26,6 +26,8 @@
 #include "debug_print.hpp"
 #include "text.hpp"
 #include "switch.hpp"
+#include "ssa_cost.hpp"
+#include "trace.hpp"
 
 //////////////
 // global_t //
@@ -230,12 +232,36 @@ void global_t::init()
     assert(compiler_phase() == PHASE_INIT);
 }
 
+bool global_t::stable_less(global_t const& a, global_t const& b)
+{
+    if(a.m_lpstring.file_i != b.m_lpstring.file_i)
+        return stable_file_rank(a.m_lpstring.file_i) < stable_file_rank(b.m_lpstring.file_i);
+    if(a.m_lpstring.offset != b.m_lpstring.offset)
+        return a.m_lpstring.offset < b.m_lpstring.offset;
+    return a.name < b.name;
+}
+
 // This function isn't thread-safe.
 // Call from a single thread only.
 void global_t::parse_cleanup()
 {
     assert(compiler_phase() == PHASE_PARSE_CLEANUP);
 
+    // Parsing is multi-threaded, so these were filled in an arbitrary order.
+    // Sort them to keep the output independent of the thread count:
+    auto const fn_less = [](fn_t const* a, fn_t const* b) { return stable_less(a->global, b->global); };
+    std::sort(modes_vec.begin(), modes_vec.end(), fn_less);
+    std::sort(nmi_vec.begin(), nmi_vec.end(), fn_less);
+    std::sort(irq_vec.begin(), irq_vec.end(), fn_less);
+    std::sort(chrrom_deque.begin(), chrrom_deque.end(), [](auto const& a, auto const& b)
+    {
+        return stable_less(*a.first, *b.first);
+    });
+    std::sort(gvar_t::m_groupless_gvars.begin(), gvar_t::m_groupless_gvars.end(), [](gvar_ht a, gvar_ht b)
+    {
+        return stable_less(a->global, b->global);
+    });
+
     // Handle solo_interrupts: 
     if(fn_t* irq = fn_t::solo_irq())
     {
@@ -337,8 +363,14 @@ void global_t::do_all(Fn const& fn)
             if(!global)
                 return;
 
-            do global = fn(*global);
+            do
+            {
+                trace_span_t const span("global", global->name);
+                global = fn(*global);
+            }
             while(global);
+
+            trace_memory();
         }
     },
     []
@@ -594,8 +626,16 @@ void global_t::count_members()
 
     gmember_ht::with_pool([total_members](auto& pool){ pool.reserve(total_members); });
 
+    // Number gmembers in a stable order, rather than in parse order:
+    std::vector<gvar_t*> gvars;
+    gvars.reserve(gvar_ht::pool().size());
     for(gvar_t& gvar : gvar_ht::values())
+        gvars.push_back(&gvar);
+    std::sort(gvars.begin(), gvars.end(), [](gvar_t const* a, gvar_t const* b) { return stable_less(a->global, b->global); });
+
+    for(gvar_t* gvar_ptr : gvars)
     {
+        gvar_t& gvar = *gvar_ptr;
         gvar.dethunkify(false);
 
         gmember_ht const begin = { gmember_ht::with_pool([](auto& pool){ return pool.size(); }) };
@@ -784,6 +824,47 @@ void global_t::compile_all()
     do_all([&](global_t& g){ return g.compile(nullptr); });
 }
 
+void global_t::release_dead_data()
+{
+    switch(compiler_phase())
+    {
+    case PHASE_COMPILE:
+        {
+            // Fn bodies are only read by the evaluator, which runs for the last time
+            // when interpreting chrrom offsets during linking.
+            // (Ct fns can't be released, as they're interpreted everywhere.)
+            bool bodies_dead = true;
+            for_each_chrrom([&](global_t*, ast_node_t const* expr) { bodies_dead &= !expr; });
+
+            for(fn_t& fn : fn_ht::values())
+            {
+                if(bodies_dead && fn.fclass != FN_CT)
+                {
+                    fn.m_def.stmts = {};
+                    fn.m_def.mods = {};
+                    fn.m_def.name_hashes = {};
+                }
+            }
+        }
+
+        // Worker threads free their pools on exit, but this thread keeps its own.
+        ssa_pool::release();
+        cfg_pool::release();
+        ssa_data_pool::release();
+        cfg_data_pool::release();
+        break;
+
+    case PHASE_ALLOC_RAM:
+        // Interferences are only used to allocate RAM.
+        for(fn_t& fn : fn_ht::values())
+            fn.m_lvars.release_interferences();
+        break;
+
+    default:
+        break;
+    }
+}
+
 global_datum_t* global_t::datum() const
 {
     switch(gclass())
@@ -833,6 +914,11 @@ fn_t::fn_t(global_t& global, type_t type, fn_def_t&& fn_def, std::unique_ptr<mod
     m_sloppy = compiler_options().sloppy || mod_test(this->mods(), MOD_sloppy);
     m_sloppy &= !mod_test(this->mods(), MOD_sloppy, false);
 
+    m_mul_table = compiler_options().mul_table || mod_test(this->mods(), MOD_mul_table);
+    m_mul_table &= !mod_test(this->mods(), MOD_mul_table, false);
+
+    m_heat = profile_heat(qualified_name());
+
     if(mod_test(this->mods(), MOD_solo_interrupt))
     {
         if(!mod_test(this->mods(), MOD_static))
@@ -852,6 +938,13 @@ fn_t::fn_t(global_t& global, type_t type, fn_def_t&& fn_def, std::unique_ptr<mod
     }
 }
 
+std::string fn_t::qualified_name() const
+{
+    if(m_fn_set)
+        return fmt("%__%", m_fn_set->global.name, global.name);
+    return global.name;
+}
+
 fn_ht fn_t::mode_nmi() const
 { 
     assert(fclass == FN_MODE); 
@@ -1279,6 +1372,18 @@ void fn_t::compile_iasm()
     rom_proc().safe().assign(std::move(proc));
 }
 
+void fn_t::compile_unreachable()
+{
+    assert(!precheck_romv());
+
+    m_ir_reads = xbitset_t<gmember_ht>(0);
+    m_ir_writes = xbitset_t<gmember_ht>(0);
+    m_ir_group_vars = xbitset_t<group_vars_ht>(0);
+    m_ir_deref_groups = xbitset_t<group_ht>(0);
+    m_ir_calls = xbitset_t<fn_ht>(0);
+    m_ir_io_pure = true;
+}
+
 void fn_t::compile()
 {
     log_t* log = nullptr;
@@ -1290,6 +1395,11 @@ void fn_t::compile()
     if(iasm)
         return compile_iasm();
 
+    // Fns unreachable from any mode, nmi, or irq never get emitted.
+    // Skip compiling them; this is mostly unused library code.
+    if(!precheck_romv())
+        return compile_unreachable();
+
     // Compile the FN.
     ssa_pool::clear();
     cfg_pool::clear();
@@ -1350,13 +1460,14 @@ void fn_t::compile()
 
             save_graph(ir, fmt("pre_id_%_%", post_byteified, iter).c_str());
             RUN_O(o_identities, log, ir);
+            RUN_O(o_mul_constants, log, ir, heat(), mul_table());
             save_graph(ir, fmt("post_id_%_%", post_byteified, iter).c_str());
 
             // 'o_loop' populates 'ai_prep', which feeds into 'o_abstract_interpret'.
             // Thus, they must occur sequentially.
             reset_ai_prep();
             save_graph(ir, fmt("pre_loop_%_%", post_byteified, iter).c_str());
-            RUN_O(o_loop, log, ir, post_byteified, sloppy());
+            RUN_O(o_loop, log, ir, post_byteified, sloppy() || heat() == HEAT_COLD, heat_unroll_cost(heat()));
             save_graph(ir, fmt("pre_ai_%_%", post_byteified, iter).c_str());
             RUN_O(o_abstract_interpret, log, ir, post_byteified);
             save_graph(ir, fmt("post_ai_%_%", post_byteified, iter).c_str());
@@ -1396,7 +1507,7 @@ void fn_t::compile()
 
     // Convert shifts and switches:
     // NOTE: Do NOT use operator || here.
-    if(o_shl_tables(log, ir) | switch_partial_to_full(ir))
+    if(o_shl_tables(log, ir) | switch_partial_to_full(ir, heat()))
         optimize_suite(false);
     save_graph(ir, "3_transform");
 
@@ -1408,8 +1519,17 @@ void fn_t::compile()
     optimize_suite(true);
     save_graph(ir, "5_o2");
 
+    // Logged alongside the real size, to calibrate the SSA cost model against isel:
+    ssa_cost_t estimate = {};
+    if(log)
+        for(cfg_node_t& cfg : ir)
+        for(ssa_ht ssa_it = cfg.ssa_begin(); ssa_it; ++ssa_it)
+            estimate += estimate_ssa_cost(*ssa_it);
+
     std::size_t const proc_size = code_gen(log, ir, *this);
     save_graph(ir, "6_cg");
+    dprint(log, "SSA_COST_ESTIMATE", estimate.cycles, estimate.bytes, proc_size);
+    trace_memory(); // Sampled while the IR is still allocated.
 
     // Calculate inline-ability
     assert(m_always_inline == false);
@@ -1428,7 +1548,7 @@ void fn_t::compile()
             if(proc_size < INLINE_SIZE_ONCE)
                 m_always_inline = true;
         }
-        else if(proc_size < INLINE_SIZE_LIMIT)
+        else if(proc_size < heat_inline_size(heat(), INLINE_SIZE_LIMIT))
         {
             bool const no_banks = ir_deref_groups().for_each_test([&](group_ht group) -> bool
             {
@@ -1450,7 +1570,7 @@ void fn_t::compile()
 
                 constexpr unsigned CALL_PENALTY = 3;
 
-                if(proc_size < INLINE_SIZE_GOAL + (call_cost * CALL_PENALTY))
+                if(proc_size < heat_inline_size(heat(), INLINE_SIZE_GOAL) + (call_cost * CALL_PENALTY))
                     m_always_inline = true;
             }
         }
@@ -2412,6 +2532,7 @@ void fn_set_t::resolve()
 {
     for(auto const& pair : m_fn_hashes)
         m_fns.push_back(pair.second->handle<fn_ht>());
+    std::sort(m_fns.begin(), m_fns.end(), [](fn_ht a, fn_ht b) { return global_t::stable_less(a->global, b->global); });
 }
 
 void fn_set_t::precheck()
@@ -31,6 +31,7 @@
 #include "debug_print.hpp"
 #include "byte_block.hpp"
 #include "ident_map.hpp"
+#include "profile.hpp"
 
 struct rom_array_t;
 struct precheck_tracked_t;
@@ -181,6 +182,10 @@ public:
     // This allocates 'gmember_t's.
     static void count_members(); 
 
+    // Orders globals by where they were defined, which unlike handle order,
+    // doesn't depend on how parsing was split between threads.
+    static bool stable_less(global_t const& a, global_t const& b);
+
     // Call after 'count_members' to build 'm_iuses' and 'm_ideps_left',
     // among other things.
     // This function isn't thread-safe.
@@ -196,6 +201,11 @@ public:
     // Call after 'build_order' to well... compile everything!
     static void compile_all();
 
+    // Frees data that won't be used after the current phase.
+    // This function isn't thread-safe.
+    // Call from a single thread only.
+    static void release_dead_data();
+
     static std::vector<fn_t*> modes() { assert(compiler_phase() > PHASE_PARSE); return modes_vec; }
     static std::vector<fn_t*> nmis() { assert(compiler_phase() > PHASE_PARSE); return nmi_vec; }
     static std::vector<fn_t*> irqs() { assert(compiler_phase() > PHASE_PARSE); return irq_vec; }
@@ -246,7 +256,7 @@ private:
 
 private:
     // Globals get allocated in these:
-    inline static ident_map_t<global_ht> global_pool_map;
+    inline static concurrent_ident_map_t<global_ht> global_pool_map;
 
     // Tracks modes: 
     inline static std::mutex modes_vec_mutex;
@@ -466,6 +476,7 @@ public:
     void precheck();
     void compile();
     void compile_iasm();
+    void compile_unreachable();
 
     fn_ht mode_nmi() const; // Returns the NMI of this mode.
     unsigned nmi_index() const;
@@ -478,6 +489,8 @@ public:
     static fn_t* solo_irq() { assert(compiler_phase() > PHASE_PARSE); return m_solo_irq; }
 
     bool sloppy() const { return m_sloppy; }
+    bool mul_table() const { return m_mul_table; }
+    heat_t heat() const { return m_heat; }
 
     precheck_tracked_t const& precheck_tracked() const { assert(m_precheck_tracked); return *m_precheck_tracked; }
     auto const& precheck_group_vars() const { assert(m_precheck_group_vars); return m_precheck_group_vars; }
@@ -534,6 +547,10 @@ public:
 
     fn_set_t* fn_set() const { return m_fn_set; }
 
+    // Like 'global.name', but includes the fn set, if any, as 'set__fn'.
+    // (Names are only unique within their set, and Mesen labels can't contain '.')
+    std::string qualified_name() const;
+
     virtual void for_each_fn(std::function<void(fn_ht)> const& fn) const override;
     
 private:
@@ -584,6 +601,12 @@ private:
     // If we're using faster, but less accurate code generation:
     bool m_sloppy = false;
 
+    // If 8-bit multiplies use a table of squares, rather than shifting and adding:
+    bool m_mul_table = false;
+
+    // How often the function runs, according to the profile:
+    heat_t m_heat = HEAT_NORMAL;
+
     // If the function should be inlined:
     bool m_always_inline = false;
 
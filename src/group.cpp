@@ -37,6 +37,14 @@ void group_t::group_members()
 
     for(group_t* group : group_vars_ht::values())
         group->vars()->group_members();
+
+    for(group_t& group : group_ht::values())
+    {
+        if(group.data())
+            group.data()->group_members();
+        if(group.omni())
+            group.omni()->group_members();
+    }
 }
 
 ///////////////////
@@ -47,6 +55,9 @@ void group_vars_t::group_members()
 {
     assert(compiler_phase() == PHASE_GROUP_MEMBERS);
 
+    // Parsing is multi-threaded, so sort to keep a stable order:
+    std::sort(m_gvars.begin(), m_gvars.end(), [](gvar_ht a, gvar_ht b) { return global_t::stable_less(a->global, b->global); });
+
     // Init the gmembers bitset
     m_gmembers.alloc();
     for(gvar_ht gv : gvars())
@@ -66,3 +77,15 @@ void group_vars_t::determine_has_init()
         }
     }
 }
+
+//////////////////
+// group_data_t //
+//////////////////
+
+void group_data_t::group_members()
+{
+    assert(compiler_phase() == PHASE_GROUP_MEMBERS);
+
+    // Parsing is multi-threaded, so sort to keep a stable order:
+    std::sort(m_consts.begin(), m_consts.end(), [](const_ht a, const_ht b) { return global_t::stable_less(a->global, b->global); });
+}
@@ -59,6 +59,8 @@ public:
 
     std::vector<const_ht> const& consts() const { assert(compiler_phase() > PHASE_PARSE); return m_consts; }
 
+    void group_members();
+
 private:
     std::mutex m_consts_mutex; // Used during parsing only.
     std::vector<const_ht> m_consts;
@@ -139,7 +141,7 @@ public:
     static void group_members();
 
 private:
-    inline static ident_map_t<group_ht> group_pool_map;
+    inline static concurrent_ident_map_t<group_ht> group_pool_map;
 };
 
 #endif
@@ -2,7 +2,10 @@
 #define IDENT_MAP_HPP
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 
 #include "robin/collection.hpp"
 #include "robin/table.hpp"
@@ -11,7 +14,9 @@
 #include "handle.hpp"
 #include "pstring.hpp"
 
-// Maps identif
+// Maps identifiers to pool values, creating them on first lookup.
+// A map can be layered on top of a shared parent map, to extend its scope
+// without copying it. Values found in the parent are used instead of creating new ones.
 template<typename Handle>
 class ident_map_t
 {
@@ -19,6 +24,13 @@ public:
     using handle_type = Handle;
     using value_type = typename Handle::value_type;
 
+    ident_map_t() = default;
+
+    // 'parent' can be null, and must not be modified afterwards.
+    explicit ident_map_t(std::shared_ptr<ident_map_t const> parent)
+    : m_parent(std::move(parent))
+    {}
+
     template<typename PString>
     value_type& lookup(PString name, std::string_view key)
     {
@@ -26,6 +38,9 @@ public:
 
         return *Handle::with_pool([&, hash, key](auto& pool)
         {
+            if(value_type* found = lookup_parents(hash, key))
+                return found;
+
             rh::apair<value_type**, bool> result = map.emplace(hash,
                 [key](value_type* ptr) -> bool
                 {
@@ -46,17 +61,105 @@ public:
 
         return Handle::with_const_pool([&, hash, view](auto const&)
         {
-            auto result = map.lookup(hash,
-                [view](value_type* ptr) -> bool
-                {
-                    return std::equal(view.begin(), view.end(), ptr->name.begin(), ptr->name.end());
-                });
-
-            return result.second ? *result.second : nullptr;
+            if(value_type* found = lookup_local(hash, view))
+                return found;
+            return lookup_parents(hash, view);
         });
     }
+
+    // Moves this map's values into a shared parent, leaving this map as an empty layer on top.
+    // Copying this map afterwards is cheap, as the parent is shared rather than copied.
+    std::shared_ptr<ident_map_t const> share()
+    {
+        if(map.size() == 0)
+            return m_parent;
+
+        std::shared_ptr<ident_map_t const> shared = std::make_shared<ident_map_t const>(std::move(*this));
+        *this = ident_map_t(shared);
+        return shared;
+    }
 private:
+    value_type* lookup_local(std::uint64_t hash, std::string_view view) const
+    {
+        auto result = map.lookup(hash,
+            [view](value_type* ptr) -> bool
+            {
+                return std::equal(view.begin(), view.end(), ptr->name.begin(), ptr->name.end());
+            });
+
+        return result.second ? *result.second : nullptr;
+    }
+
+    value_type* lookup_parents(std::uint64_t hash, std::string_view view) const
+    {
+        for(ident_map_t const* parent = m_parent.get(); parent; parent = parent->m_parent.get())
+            if(value_type* found = parent->lookup_local(hash, view))
+                return found;
+        return nullptr;
+    }
+
     rh::robin_auto_table<value_type*> map;
+    std::shared_ptr<ident_map_t const> m_parent;
+};
+
+// A sharded version of 'ident_map_t', for maps that every thread uses during parsing.
+// Each shard has its own lock, and the pool lock is only held to create new values.
+// As values are still created in lookup order, handles are numbered the same as 'ident_map_t'.
+template<typename Handle>
+class concurrent_ident_map_t
+{
+public:
+    using handle_type = Handle;
+    using value_type = typename Handle::value_type;
+
+    template<typename PString>
+    value_type& lookup(PString name, std::string_view key)
+    {
+        std::uint64_t const hash = fnv1a<std::uint64_t>::hash(key.data(), key.size());
+        shard_t& shard = get_shard(hash);
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        rh::apair<value_type**, bool> result = shard.map.emplace(hash,
+            [key](value_type* ptr) -> bool
+            {
+                return std::equal(key.begin(), key.end(), ptr->name.begin(), ptr->name.end());
+            },
+            [name, key]() -> value_type*
+            { 
+                return Handle::with_pool([&](auto& pool) { return &pool.emplace_back(name, key, pool.size()); });
+            });
+
+        return **result.first;
+    }
+
+    value_type* lookup(std::string_view view)
+    {
+        std::uint64_t const hash = fnv1a<std::uint64_t>::hash(view.data(), view.size());
+        shard_t& shard = get_shard(hash);
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto result = shard.map.lookup(hash,
+            [view](value_type* ptr) -> bool
+            {
+                return std::equal(view.begin(), view.end(), ptr->name.begin(), ptr->name.end());
+            });
+
+        return result.second ? *result.second : nullptr;
+    }
+private:
+    static constexpr unsigned SHARD_BITS = 6;
+
+    // Aligned to avoid false sharing between threads.
+    struct alignas(64) shard_t
+    {
+        std::mutex mutex;
+        rh::robin_auto_table<value_type*> map;
+    };
+
+    // The low bits index the shard's table, so the high bits pick the shard.
+    shard_t& get_shard(std::uint64_t hash) { return m_shards[hash >> (64 - SHARD_BITS)]; }
+
+    std::array<shard_t, 1 << SHARD_BITS> m_shards;
 };
 
 #endif
@@ -1,9 +1,11 @@
 #ifndef INTRUSIVE_POOL
 #define INTRUSIVE_POOL
 
+#include <bit>
 #include <cassert>
 #include <cstdint>
 #include <memory>
+#include <new>
 #include <utility>
 #include <vector>
 #include <type_traits>
@@ -11,9 +13,10 @@
 #include "debug_print.hpp"
 #include "handle.hpp"
 
-// A simple pool based on a single vector, providing handles (indexes) into
-// the vector instead of pointers.
-// Pointers are invalidated upon allocation, but handles aren't.
+// A pool that allocates nodes in fixed-size chunks, providing handles (indexes)
+// into the chunks instead of pointers.
+// Nodes never move, so neither pointers nor handles are invalidated by allocation.
+// Chunks are kept around after 'clear', to be reused by the next user of the pool.
 // 'T' must derive from 'intrusive_t', which provides an intrusive
 // linked-list interface for handling freed nodes.
 template<typename T>
@@ -22,31 +25,89 @@ class intrusive_pool_t
 public:
     struct handle_t : public ::handle_t<handle_t, std::uint32_t, 0u>
     {
-        T const& get(intrusive_pool_t const& pool) const 
-        { 
-            assert(this->operator bool()); 
-            passert(this->id < pool.storage.size(), this->id, pool.storage.size()); 
-            return pool.storage[this->id]; 
+        T const& get(intrusive_pool_t const& pool) const
+        {
+            assert(this->operator bool());
+            passert(this->id < pool.next_id, this->id, pool.next_id);
+            return pool.slot(this->id);
         }
 
-        T& get(intrusive_pool_t& pool) const 
-        { 
-            assert(this->operator bool()); 
-            passert(this->id < pool.storage.size(), this->id, pool.storage.size()); 
-            return pool.storage[this->id]; 
+        T& get(intrusive_pool_t& pool) const
+        {
+            assert(this->operator bool());
+            passert(this->id < pool.next_id, this->id, pool.next_id);
+            return pool.slot(this->id);
         }
 
-        handle_t next(intrusive_pool_t const& pool) const { return pool.storage[this->id].next; }
-        handle_t prev(intrusive_pool_t const& pool) const { return pool.storage[this->id].prev; }
+        handle_t next(intrusive_pool_t const& pool) const { return pool.slot(this->id).next; }
+        handle_t prev(intrusive_pool_t const& pool) const { return pool.slot(this->id).prev; }
     };
 private:
-    std::vector<T> storage = std::vector<T>(1);
+    // Each chunk is aligned to its own size, letting a node's handle be found from its address.
+    // The first slot of each chunk stores a header instead of a node.
+    // (This also reserves id 0 for null handles.)
+    static constexpr std::size_t CHUNK_SHIFT = 10;
+    static constexpr std::size_t CHUNK_SLOTS = 1 << CHUNK_SHIFT;
+    static constexpr std::size_t CHUNK_MASK = CHUNK_SLOTS - 1;
+
+    // (A function, as 'T' is incomplete when the class is instantiated.)
+    static constexpr std::size_t chunk_bytes() { return std::bit_ceil(CHUNK_SLOTS * sizeof(T)); }
+
+    struct chunk_header_t
+    {
+        std::uint32_t index;
+    };
+
+    struct chunk_delete_t
+    {
+        void operator()(char* ptr) const noexcept
+        {
+            ::operator delete(ptr, chunk_bytes(), std::align_val_t(chunk_bytes()));
+        }
+    };
+
+    struct chunk_t
+    {
+        std::unique_ptr<char, chunk_delete_t> storage;
+    };
+
+    std::vector<chunk_t> chunks;
     handle_t free_head = {};
+    std::uint32_t next_id = 1; // Ids below this have been constructed.
     std::size_t used_size = 0;
+
+    T& slot(std::uint32_t id) const
+    {
+        assert(id & CHUNK_MASK);
+        return reinterpret_cast<T*>(chunks[id >> CHUNK_SHIFT].storage.get())[id & CHUNK_MASK];
+    }
+
+    void alloc_chunk()
+    {
+        static_assert(sizeof(chunk_header_t) <= sizeof(T));
+
+        std::unique_ptr<char, chunk_delete_t> storage(
+            static_cast<char*>(::operator new(chunk_bytes(), std::align_val_t(chunk_bytes()))));
+
+        new (storage.get()) chunk_header_t{ std::uint32_t(chunks.size()) };
+        chunks.push_back({ std::move(storage) });
+    }
+
+    void destroy_nodes()
+    {
+        if(!std::is_trivially_destructible<T>::value)
+            for(std::uint32_t id = 1; id < next_id; ++id)
+                if(id & CHUNK_MASK)
+                    slot(id).~T();
+    }
 public:
-    handle_t alloc() 
+    intrusive_pool_t() = default;
+    intrusive_pool_t(intrusive_pool_t const&) = delete;
+    intrusive_pool_t& operator=(intrusive_pool_t const&) = delete;
+    ~intrusive_pool_t() { destroy_nodes(); }
+
+    handle_t alloc()
     {
-        assert(storage.size() > 0);
         handle_t ret;
         if(free_head)
         {
@@ -55,12 +116,19 @@ public:
         }
         else
         {
-            ret = { storage.size() };
-            storage.emplace_back();
+            if(!(next_id & CHUNK_MASK))
+                ++next_id; // Skip the chunk header.
+
+            if((next_id >> CHUNK_SHIFT) >= chunks.size())
+                alloc_chunk();
+
+            ret = { next_id };
+            new (&slot(next_id)) T();
+            ++next_id;
         }
         ++used_size;
         assert(ret);
-        assert(ret.id < storage.size());
+        assert(ret.id < next_id);
         return ret;
     }
 
@@ -74,16 +142,41 @@ public:
 
     void clear()
     {
-        storage.resize(1);
+        destroy_nodes();
         free_head = {};
+        next_id = 1;
         used_size = 0;
     }
 
-    void reserve(std::size_t size) { storage.reserve(size); }
+    // Frees the chunks, which 'clear' keeps around.
+    void release()
+    {
+        clear();
+        chunks.clear();
+        chunks.shrink_to_fit();
+    }
+
+    void reserve(std::size_t size)
+    {
+        while(chunks.size() * (CHUNK_SLOTS - 1) < size)
+            alloc_chunk();
+    }
+
+    // Finds the handle of a node allocated by this pool.
+    handle_t handle(T const* ptr) const
+    {
+        std::uintptr_t const addr = reinterpret_cast<std::uintptr_t>(ptr);
+        std::uintptr_t const chunk_addr = addr & ~std::uintptr_t(chunk_bytes() - 1);
+        std::uint32_t const index = reinterpret_cast<chunk_header_t const*>(chunk_addr)->index;
+        assert(index < chunks.size() && chunks[index].storage.get() == reinterpret_cast<char const*>(chunk_addr));
+        return { (index << CHUNK_SHIFT) | std::uint32_t((addr - chunk_addr) / sizeof(T)) };
+    }
 
     std::size_t size() { return used_size; }
-    std::size_t array_size() { return storage.size(); }
-    T* data() { return storage.data(); }
+    std::size_t array_size() { return next_id; }
+
+    // An upper bound of 'array_size()' after 'n' more allocations.
+    std::size_t array_size_after(std::size_t n) { return next_id + n + (n / (CHUNK_SLOTS - 1)) + 1; }
 };
 
 template<typename Handle>
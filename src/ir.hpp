@@ -128,7 +128,7 @@ public:
     ssa_node_t(ssa_node_t&&) = default;
     ssa_node_t& operator=(ssa_node_t&&) = default;
 
-    ssa_ht handle() const { return { this - ssa_pool::data() }; }
+    ssa_ht handle() const { return ssa_pool::handle(this); }
 
     cfg_ht cfg_node() const { return m_cfg_h; }
     cfg_ht input_cfg(std::size_t i) const;
@@ -230,7 +230,7 @@ public:
     cfg_node_t(cfg_node_t&&) = default;
     cfg_node_t& operator=(cfg_node_t&&) = default;
 
-    cfg_ht handle() const { return { this - cfg_pool::data() }; }
+    cfg_ht handle() const { return cfg_pool::handle(this); }
 
     cfg_ht input(unsigned i) const { return m_io.input(i).handle; }
     cfg_fwd_edge_t input_edge(unsigned i) const { return m_io.input(i); }
@@ -3,6 +3,7 @@
 #include "flat/small_set.hpp"
 
 #include "globals.hpp"
+#include "ssa_cost.hpp"
 #include "worklist.hpp"
 
 bool io_pure(ssa_node_t const& ssa_node)
@@ -53,33 +54,7 @@ unsigned estimate_cost(ssa_node_t const& ssa_node)
     if(ssa_flags(ssa_node.op()) & SSAF_EXPENSIVE)
         return 1024;
 
-    if(ssa_input0_class(ssa_node.op()) == INPUT_LINK)
-        return 0;
-
-    if(ssa_flags(ssa_node.op()) & SSAF_FREE)
-        return 0;
-
-    if(ssa_flags(ssa_node.op()) & SSAF_CONDITIONAL)
-        return 4; // somewhat arbitrary
-
-    if(ssa_derefs_ptr(ssa_node.op()))
-        return 2; // somewhat arbitrary
-
-    if(ssa_flags(ssa_node.op()) & SSAF_INDEXES_ARRAY8)
-        return 2; // somewhat arbitrary
-
-    if(ssa_flags(ssa_node.op()) & SSAF_INDEXES_ARRAY16)
-        return 16; // somewhat arbitrary
-
-    unsigned cost = 0;
-
-    unsigned const input_size = ssa_node.input_size();
-    for(unsigned i = 0; i < input_size; ++i)
-        cost += ssa_node.input(i).type().size_of();
-
-    cost = std::max<unsigned>(cost, ssa_node.type().size_of());
-
-    return cost;
+    return estimate_ssa_cost(ssa_node).bytes;
 }
 
 void steal_ssa_after(ssa_ht ssa, cfg_ht steal_dest)
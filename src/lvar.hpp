@@ -70,12 +70,30 @@ public:
         });
     }
 
+    // Like above, but only adds the edges between 'i' and 'bs'.
+    // Use this when 'i' joins a set whose interferences were already added.
+    void add_lvar_interferences(unsigned i, bitset_uint_t const* bs)
+    {
+        bitset_or(bitset_size(), lvar_interferences(i), bs);
+        bitset_for_each(bitset_size(), bs, [this, i](unsigned j)
+        {
+            bitset_set(lvar_interferences(j), i);
+        });
+    }
+
     void add_fn_interference(unsigned i, fn_ht fn)
     { 
         assert(i < m_fn_interferences.size());
         m_fn_interferences[i].insert(fn); 
     }
 
+    // Frees memory once RAM has been allocated.
+    void release_interferences()
+    {
+        m_lvar_interferences = {};
+        m_fn_interferences = {};
+    }
+
     static bool is_this_lvar(fn_ht fn, locator_t arg);
     static bool is_call_lvar(fn_ht fn, locator_t arg);
     static bool is_lvar(fn_ht fn, locator_t arg) { return is_this_lvar(fn, arg) || is_call_lvar(fn, arg); }
@@ -1,7 +1,12 @@
 #include "macro.hpp"
 
+#include <exception>
+#include <memory>
+#include <mutex>
+
 #include <boost/container/small_vector.hpp>
 
+#include "robin/map.hpp"
 #include "robin/set.hpp"
 
 #include "macro_lex_tables.hpp"
@@ -28,29 +33,78 @@ static token_type_t do_lex(char const*& str)
     return lexed;
 }
 
-std::string invoke_macro(unsigned file_i, std::vector<std::string> const& args)
+namespace
 {
-    file_contents_t file(file_i);
 
-    std::string ret;
-    std::vector<std::string> params;
+// A macro file, lexed once into literal text and parameter slots.
+// Invoking the macro concatenates these segments.
+struct macro_template_t
+{
+    enum segment_class_t : std::uint8_t
+    {
+        SEG_LITERAL,
+        SEG_ARG,        // #name#
+        SEG_CAMEL,      // -#name#- and =#name#=
+        SEG_QUOTED,     // "#name#", '#name#', and `#name#`
+    };
+
+    struct segment_t
+    {
+        segment_class_t sclass;
+        char quote = 0; // For SEG_QUOTED
+        bool upper = false; // For SEG_CAMEL, capitalizes the first letter.
+        unsigned param = 0;
+        std::string literal; // For SEG_LITERAL
+    };
+
+    std::vector<segment_t> segments;
+    std::size_t literal_size = 0;
+
+    // Errors are cached too, and rethrown by every invocation:
+    std::exception_ptr error;
+
+    explicit macro_template_t(unsigned file_i);
+
+    std::string expand(std::vector<std::string> const& args) const;
+
+private:
+    void lex(unsigned file_i);
+};
+
+macro_template_t::macro_template_t(unsigned file_i)
+{
+    try { lex(file_i); }
+    catch(...) { error = std::current_exception(); }
+}
+
+void macro_template_t::lex(unsigned file_i)
+{
+    file_contents_t file(file_i);
+    rh::batman_map<std::string, unsigned> params;
 
     char quote;
 
     char const* str = file.source();
 
+    auto const literal_text = [&]() -> std::string&
+    {
+        if(segments.empty() || segments.back().sclass != SEG_LITERAL)
+            segments.push_back({ SEG_LITERAL });
+        return segments.back().literal;
+    };
+
     while(*str)
     {
         char const* begin = str;
 
         auto error = [&](std::string const& msg){ throw macro_error_t(msg, { begin - file.source(), str - begin, file_i }); };
         
-        auto const find = [&](std::string const& name)
+        auto const find = [&](std::string const& name) -> unsigned
         {
-            auto it = std::find(params.begin(), params.end(), name);
-            if(it == params.end())
+            unsigned const* i = params.mapped(name);
+            if(!i)
                 error(fmt("Macro parameter #%# must be declared before use.", name));
-            return it - params.begin();
+            return *i;
         };
 
         bool next_upper = false;
@@ -69,6 +123,7 @@ std::string invoke_macro(unsigned file_i, std::vector<std::string> const& args)
                 try { str = parse_string_literal(literal, file.source(), str-1, quote, file_i); }
                 catch(std::exception const& e) { error(e.what()); }
                 catch(...) { throw; }
+                std::string& ret = literal_text();
                 ret.push_back(quote);
                 ret += literal.string;
                 ret.push_back(quote);
@@ -76,80 +131,131 @@ std::string invoke_macro(unsigned file_i, std::vector<std::string> const& args)
             break;
 
         case TOK_ident:
-            {
-                unsigned const i = find(std::string(begin+1, str-1));
-                if(i < args.size())
-                    ret += args[i];
-            }
+            segments.push_back({ .sclass = SEG_ARG, .param = find(std::string(begin+1, str-1)) });
             break;
 
         case TOK_eq_ident: 
             next_upper = true;
             // fall-through
         case TOK_dash_ident:
-            {
-                unsigned const i = find(std::string(begin+2, str-2));
-                if(i < args.size())
-                {
-                    for(unsigned j = 0; j < args[i].size(); ++j)
-                    {
-                        char const c = args[i][j];
-
-                        if(c == '_')
-                        {
-                            if(j != 0)
-                            {
-                                next_upper = true;
-                                continue;
-                            }
-                        }
-                        else if(next_upper)
-                        {
-                            ret.push_back(std::toupper(c));
-                            next_upper = false;
-                            continue;
-                        }
-
-                        ret.push_back(c);
-                    }
-                }
-            };
+            segments.push_back({ .sclass = SEG_CAMEL, .upper = next_upper, .param = find(std::string(begin+2, str-2)) });
             break;
 
         case TOK_dquote_ident:   quote = '"';  goto quote_replace;
         case TOK_quote_ident:    quote = '\''; goto quote_replace;
         case TOK_backtick_ident: quote = '`';  goto quote_replace;
         quote_replace:
-            {
-                unsigned const i = find(std::string(begin+2, str-2));
-                ret.push_back(quote);
-                if(i < args.size())
-                    ret += escape(args[i]);
-                ret.push_back(quote);
-            }
+            segments.push_back({ .sclass = SEG_QUOTED, .quote = quote, .param = find(std::string(begin+2, str-2)) });
             break;
 
         case TOK_colon_ident:
-            {
-                std::string name(begin+2, str-2);
-                auto it = std::find(params.begin(), params.end(), name);
-                if(it != params.end())
-                    error("Macro parameters declared twice.");
-                params.emplace_back(std::move(name));
-            }
+            if(!params.insert({ std::string(begin+2, str-2), params.size() }).second)
+                error("Macro parameters declared twice.");
             break;
 
         default:
-            ret.insert(ret.end(), begin, str);
+            literal_text().append(begin, str);
             break;
 
         case TOK_ERROR:
             ++str;
-            ret.push_back(*begin);
+            literal_text().push_back(*begin);
             break;
         }
     }
 done:
 
+    for(segment_t const& segment : segments)
+        literal_size += segment.literal.size();
+}
+
+std::string macro_template_t::expand(std::vector<std::string> const& args) const
+{
+    if(error)
+        std::rethrow_exception(error);
+
+    std::size_t size = literal_size;
+    for(segment_t const& segment : segments)
+        if(segment.sclass != SEG_LITERAL && segment.param < args.size())
+            size += args[segment.param].size() + 2;
+
+    std::string ret;
+    ret.reserve(size);
+
+    for(segment_t const& segment : segments)
+    {
+        if(segment.sclass == SEG_LITERAL)
+        {
+            ret += segment.literal;
+            continue;
+        }
+
+        std::string const* arg = segment.param < args.size() ? &args[segment.param] : nullptr;
+
+        switch(segment.sclass)
+        {
+        default:
+            if(arg)
+                ret += *arg;
+            break;
+
+        case SEG_CAMEL:
+            if(arg)
+            {
+                bool next_upper = segment.upper;
+
+                for(unsigned j = 0; j < arg->size(); ++j)
+                {
+                    char const c = (*arg)[j];
+
+                    if(c == '_')
+                    {
+                        if(j != 0)
+                        {
+                            next_upper = true;
+                            continue;
+                        }
+                    }
+                    else if(next_upper)
+                    {
+                        ret.push_back(std::toupper(c));
+                        next_upper = false;
+                        continue;
+                    }
+
+                    ret.push_back(c);
+                }
+            }
+            break;
+
+        case SEG_QUOTED:
+            ret.push_back(segment.quote);
+            if(arg)
+                ret += escape(*arg);
+            ret.push_back(segment.quote);
+            break;
+        }
+    }
+
     return ret;
 }
+
+std::mutex template_mutex;
+rh::batman_map<unsigned, std::unique_ptr<macro_template_t>> templates;
+
+} // end anonymous namespace
+
+std::string invoke_macro(unsigned file_i, std::vector<std::string> const& args)
+{
+    macro_template_t const* t;
+
+    {
+        std::lock_guard<std::mutex> lock(template_mutex);
+        std::unique_ptr<macro_template_t>& ptr = templates[file_i];
+        if(!ptr)
+            ptr.reset(new macro_template_t(file_i));
+        t = ptr.get();
+    }
+
+    return t->expand(args);
+}
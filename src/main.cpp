@@ -21,6 +21,7 @@
 #include "rom_link.hpp"
 #include "ram_init.hpp"
 #include "cg_isel.hpp"
+#include "convert_png.hpp"
 #include "text.hpp"
 #include "compiler_error.hpp"
 #include "string.hpp"
@@ -28,6 +29,8 @@
 #include "macro.hpp"
 #include "guard.hpp"
 #include "ctags.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
 
 extern char __GIT_COMMIT;
 
@@ -128,6 +131,9 @@ void handle_options(fs::path dir, po::options_description const& cfg_desc, po::v
     if(vm.count("ctags"))
         _options.raw_ctags = (dir / fs::path(vm["ctags"].as<std::string>())).string();
 
+    if(vm.count("profile"))
+        _options.raw_profile = (dir / fs::path(vm["profile"].as<std::string>())).string();
+
     if(vm.count("graphviz"))
         _options.graphviz = true;
 
@@ -137,6 +143,9 @@ void handle_options(fs::path dir, po::options_description const& cfg_desc, po::v
     if(vm.count("build-time"))
         _options.build_time = true;
 
+    if(vm.count("trace"))
+        _options.raw_trace = (dir / fs::path(vm["trace"].as<std::string>())).string();
+
     if(vm.count("error-on-warning"))
         _options.werror = true;
 
@@ -152,6 +161,9 @@ void handle_options(fs::path dir, po::options_description const& cfg_desc, po::v
     if(vm.count("timelimit"))
         _options.time_limit = std::max(vm["timelimit"].as<int>(), 0);
 
+    if(vm.count("isel-budget"))
+        _options.isel_budget = std::max(vm["isel-budget"].as<int>(), 0);
+
     if(vm.count("mapper"))
         _options.raw_mn = vm["mapper"].as<std::string>();
 
@@ -236,9 +248,21 @@ void handle_options(fs::path dir, po::options_description const& cfg_desc, po::v
     if(vm.count("sloppy"))
         _options.sloppy = true;
 
+    if(vm.count("mul-table"))
+        _options.mul_table = true;
+
+    if(vm.count("verify-determinism"))
+        _options.verify_determinism = true;
+
+    if(vm.count("lean"))
+        _options.lean = true;
+
     if(vm.count("unsafe-bank-switch"))
         _options.unsafe_bank_switch = true;
 
+    if(vm.count("bank-affinity"))
+        _options.bank_affinity = true;
+
     if(vm.count("multicart"))
     {
         std::string str = to_lower(vm["multicart"].as<std::string>());
@@ -259,6 +283,87 @@ void handle_options(fs::path dir, po::options_description const& cfg_desc, po::v
         _options.vram_init = true;
 }
 
+static std::string determinism_suffix(int num_threads)
+{
+    return fmt(".j%", num_threads);
+}
+
+// Runs the build twice, once single-threaded and once with multiple threads,
+// then compares the ROMs and label files byte-for-byte.
+static int verify_determinism(int argc, char** argv)
+{
+    using namespace std::literals;
+
+    auto const quote = [](std::string_view arg)
+    {
+#ifdef _WIN32
+        return fmt("\"%\"", arg);
+#else
+        std::string ret = "'";
+        for(char c : arg)
+        {
+            if(c == '\'')
+                ret += "'\\''";
+            else
+                ret.push_back(c);
+        }
+        ret.push_back('\'');
+        return ret;
+#endif
+    };
+
+    std::string base_cmd = quote(argv[0]);
+    for(int i = 1; i < argc; ++i)
+    {
+        if(argv[i] != "--verify-determinism"sv)
+        {
+            base_cmd += ' ';
+            base_cmd += quote(argv[i]);
+        }
+    }
+
+    int const thread_counts[2] = { 1, std::max(2, compiler_options().num_threads) };
+
+    for(int num_threads : thread_counts)
+    {
+        std::string cmd = fmt("% --determinism-threads %", base_cmd, num_threads);
+#ifdef _WIN32
+        cmd = fmt("\"%\"", cmd); // cmd.exe strips the outer quotes.
+#endif
+        std::fflush(stdout);
+        if(std::system(cmd.c_str()) != 0)
+            return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> outputs = { compiler_options().output_file };
+    if(!compiler_options().raw_mlb.empty())
+        outputs.push_back(compiler_options().raw_mlb);
+
+    for(std::string const& output : outputs)
+    {
+        std::string const a = output + determinism_suffix(thread_counts[0]);
+        std::string const b = output + determinism_suffix(thread_counts[1]);
+        std::vector<std::uint8_t> const a_data = read_binary_file(a);
+        std::vector<std::uint8_t> const b_data = read_binary_file(b);
+
+        auto const mismatch = std::mismatch(a_data.begin(), a_data.end(), b_data.begin(), b_data.end());
+        if(mismatch.first != a_data.end() || mismatch.second != b_data.end())
+        {
+            throw std::runtime_error(fmt("Nondeterministic build: % and % differ at byte %.", 
+                                         a, b, mismatch.first - a_data.begin()));
+        }
+    }
+
+    // The outputs match. Keep the multi-threaded build's files as the result.
+    for(std::string const& output : outputs)
+    {
+        fs::remove(output + determinism_suffix(thread_counts[0]));
+        fs::rename(output + determinism_suffix(thread_counts[1]), output);
+    }
+
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char** argv)
 {
     auto entry_time = std::chrono::system_clock::now();
@@ -280,6 +385,7 @@ int main(int argc, char** argv)
             po::options_description cmdline_hidden("Hidden command line options");
             cmdline_hidden.add_options()
                 ("print-cpp-sizes", "print size of C++ objects")
+                ("determinism-threads", po::value<int>(), "internal use by --verify-determinism")
             ;
 
             po::options_description basic("Options");
@@ -292,6 +398,10 @@ int main(int argc, char** argv)
                 ("error-on-warning,W", "turn warnings into errors")
                 ("pause", "await input on stdin before exiting")
                 ("sloppy", "faster compile times, but worse optimization")
+                ("mul-table", "faster multiplication, using 1KiB of tables")
+                ("isel-budget", po::value<int>(), "instruction selection work per function (in thousands of selections, 0 is off)")
+                ("verify-determinism", "build twice using different thread counts and compare the outputs")
+                ("lean", "lower memory use by freeing data as soon as it's unused")
             ;
 
             po::options_description mapper_opt("Mapper options");
@@ -312,6 +422,8 @@ int main(int argc, char** argv)
                 ("unsafe-bank-switch", "faster but less safe bank switches")
                 ("mlb", po::value<std::string>(), "generate Mesen label file")
                 ("ctags", po::value<std::string>(), "generate Ctags file")
+                ("profile", po::value<std::string>(), "optimize using an emulator cycle profile")
+                ("bank-affinity", "place functions that call each other in the same bank")
             ;
 
             po::options_description basic_hidden("Hidden options");
@@ -324,6 +436,7 @@ int main(int argc, char** argv)
                 ("rom-info", "output ROM info")
                 ("time-limit,T", po::value<int>(), "interpreter execution time limit (in ms, 0 is off)")
                 ("build-time,B", "print compiler execution time")
+                ("trace", po::value<std::string>(), "write a trace of the compiler's work, in Chrome's trace event format")
                 ("fast-debug", "faster debugging")
                 ("ram-init", "initialize RAM with 0 bytes")
                 ("sram-init", "initialize SRAM with 0 bytes")
@@ -391,6 +504,20 @@ int main(int argc, char** argv)
             if(compiler_options().source_names.empty())
                 throw std::runtime_error("No input files.");
 
+            if(vm.count("determinism-threads"))
+            {
+                // This is one of the builds spawned by '--verify-determinism'.
+                // Its outputs get a suffix, so that the parent can compare them.
+                _options.verify_determinism = false;
+                _options.pause = false;
+                _options.num_threads = std::clamp(vm["determinism-threads"].as<int>(), 1, 1024);
+                std::string const suffix = determinism_suffix(_options.num_threads);
+                _options.output_file += suffix;
+                if(!_options.raw_mlb.empty())
+                    _options.raw_mlb += suffix;
+                _options.raw_ctags.clear();
+            }
+
             using namespace std::literals;
 
             // Handle mapper:
@@ -475,6 +602,9 @@ int main(int argc, char** argv)
             }
         }
 
+        if(compiler_options().verify_determinism)
+            return verify_determinism(argc, argv);
+
         // Append macro_names onto source_names:
         _options.num_fab = _options.source_names.size();
         for(auto const& pair : compiler_options().macro_names)
@@ -485,6 +615,8 @@ int main(int argc, char** argv)
         ////////////////////////////////////
 
         auto time = std::chrono::system_clock::now();
+        if(compiler_options().build_time)
+            peak_rss_kib(); // Start measuring from here.
 
         auto const output_time = [&time](char const* desc)
         {
@@ -492,7 +624,10 @@ int main(int argc, char** argv)
             {
                 auto now = std::chrono::system_clock::now();
                 unsigned long long const ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - time).count();
-                std::printf("time %s %8lli ms\n", desc, ms);
+                if(unsigned long const kib = peak_rss_kib())
+                    std::printf("time %s %8lli ms %8lu KiB peak\n", desc, ms, kib);
+                else
+                    std::printf("time %s %8lli ms\n", desc, ms);
                 time = std::chrono::system_clock::now();
             }
         };
@@ -515,36 +650,31 @@ int main(int argc, char** argv)
                 throw std::runtime_error(fmt("Unable to write Ctags file %", compiler_options().raw_ctags));
         }
 
+        if(!compiler_options().raw_profile.empty())
+            load_profile(compiler_options().raw_profile);
+
         output_time("init:     ");
 
         set_compiler_phase(PHASE_PARSE_MACROS);
 
         // Parse the files, loading everything into globals:
         set_compiler_phase(PHASE_PARSE);
-        std::atomic<unsigned> next_file_i = 0;
-        unsigned end_file_i = compiler_options().num_fab;
+        start_parse_files(compiler_options().num_fab);
 
-        do
+        parallelize(compiler_options().num_threads,
+        [](std::atomic<bool>& exception_thrown)
         {
-            parallelize(compiler_options().num_threads,
-            [&next_file_i, end_file_i](std::atomic<bool>& exception_thrown)
+            unsigned file_i;
+            while(!exception_thrown && next_parse_file(file_i))
             {
-                while(!exception_thrown)
-                {
-                    unsigned const file_i = next_file_i++;
-                    if(file_i >= end_file_i)
-                        return;
-
-                    file_contents_t file(file_i);
-                    parse<pass1_t>(file);
-                }
-            }, []{});
+                file_contents_t file(file_i);
+                trace_span_t const span("parse", file.path().string());
+                parse<pass1_t>(file);
+                finish_parse_file();
+            }
+        }, abort_parse_files);
 
-            auto pair = finalize_macros();
-            next_file_i = pair.first;
-            end_file_i = pair.second;
-        }
-        while(next_file_i < end_file_i);
+        finalize_macros();
 
         // Fix various things after parsing:
         set_compiler_phase(PHASE_PARSE_CLEANUP);
@@ -614,6 +744,9 @@ int main(int argc, char** argv)
             }
         });
 
+        if(compiler_options().lean)
+            global_t::release_dead_data();
+
         set_compiler_phase(PHASE_ALLOC_RAM);
         alloc_ram(nullptr, ~static_used_ram);
 
@@ -625,6 +758,9 @@ int main(int argc, char** argv)
             if(of.is_open())
                 print_ram(of);
         }
+
+        if(compiler_options().lean)
+            global_t::release_dead_data();
         output_time("alloc ram:");
 
         set_compiler_phase(PHASE_RESET_PROC);
@@ -650,7 +786,10 @@ int main(int argc, char** argv)
 
             std::ofstream of(fmt("info/ROM_info.txt"));
             if(of.is_open())
+            {
+                print_chr_tiles(of);
                 print_rom(of);
+            }
         }
         output_time("alloc rom:");
 
@@ -675,6 +814,9 @@ int main(int argc, char** argv)
             write_ctags(ctags_out, compiler_options().raw_ctags);
             std::fclose(ctags_out);
         }
+
+        if(tracing())
+            write_trace(compiler_options().raw_trace);
     }
 #ifdef NDEBUG // In debug mode, we get better stack traces without catching.
     catch(std::exception& e)
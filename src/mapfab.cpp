@@ -1,7 +1,8 @@
 #include "mapfab.hpp"
 
 #include <array>
-#include <map>
+
+#include "robin/map.hpp"
 
 #include "json.hpp"
 
@@ -35,6 +36,8 @@ struct mapfab_t
         std::uint8_t se;
 
         auto operator<=>(mt_t const&) const = default;
+
+        std::uint32_t key() const { return nw | (ne << 8) | (sw << 16) | (std::uint32_t(se) << 24); }
     };
 
     struct mt_set_t
@@ -56,7 +59,7 @@ struct mapfab_t
         std::vector<std::uint8_t> sw32;
         std::vector<std::uint8_t> se32;
         std::vector<std::uint8_t> attributes32;
-        std::map<mt_t, unsigned> map32;
+        rh::robin_map<std::uint32_t, unsigned> map32; // Maps 'mt_t::key' to its 32x32 metatile.
     };
 
     struct field_t
@@ -483,8 +486,18 @@ void mapfab_t::load_json(std::uint8_t const* const begin, std::size_t size, fs::
 
 void mapfab_t::compute_mmt_32()
 {
+    rh::robin_map<std::string, mt_set_t*> mt_set_map;
+    for(auto& mt_set : mt_sets)
+        mt_set_map.insert({ mt_set.name, &mt_set }); // Keeps the first of any duplicate names.
+
     for(auto& level : levels)
     {
+        mt_set_t* const* const mt_set_ptr = mt_set_map.mapped(level.metatiles_name);
+        if(!mt_set_ptr)
+            throw std::runtime_error(fmt("MapFab error: Undefined metatile set % used in level %.", 
+                                         level.metatiles_name, level.name));
+        mt_set_t* const mt_set = *mt_set_ptr;
+
         level.tiles32.clear();
         level.tiles32.reserve((level.w * level.h) / 4);
 
@@ -499,21 +512,7 @@ void mapfab_t::compute_mmt_32()
             mt.sw = s ? level.tiles[(x) + (y+1)*level.w] : 0;
             mt.se = s && e ? level.tiles[(x+1) + (y+1)*level.w] : 0;
 
-            mt_set_t* mt_set = nullptr;
-            for(auto& m : mt_sets)
-            {
-                if(m.name == level.metatiles_name)
-                {
-                    mt_set = &m;
-                    break;
-                }
-            }
-
-            if(!mt_set)
-                throw std::runtime_error(fmt("MapFab error: Undefined metatile set % used in level %.", 
-                                             level.metatiles_name, level.name));
-
-            auto result = mt_set->map32.emplace(mt, mt_set->map32.size());
+            auto result = mt_set->map32.insert({ mt.key(), mt_set->map32.size() });
             if(result.second)
             {
                 mt_set->nw32.push_back(mt.nw);
@@ -539,8 +538,8 @@ void mapfab_t::compute_mmt_32()
 
 void convert_mapfab(mapfab_convert_type_t ct, std::uint8_t const* const begin, std::size_t size, 
                     lpstring_t at, fs::path mapfab_path, mapfab_macros_t const& macros,
-                    ident_map_t<global_ht>* base_private_globals,
-                    ident_map_t<group_ht>* base_private_groups)
+                    std::shared_ptr<ident_map_t<global_ht> const> base_private_globals,
+                    std::shared_ptr<ident_map_t<group_ht> const> base_private_groups)
 {
     using namespace std::literals;
 
@@ -559,12 +558,9 @@ void convert_mapfab(mapfab_convert_type_t ct, std::uint8_t const* const begin, s
     {
         auto const& chr = mapfab.chrs[i];
 
-        ident_map_t<global_ht> private_globals;
-        if(base_private_globals)
-            private_globals = *base_private_globals;
-        ident_map_t<group_ht> private_groups;
-        if(base_private_groups)
-            private_groups = *base_private_groups;
+        // Each invocation gets its own private scope, layered on the base one.
+        ident_map_t<global_ht> private_globals(base_private_globals);
+        ident_map_t<group_ht> private_groups(base_private_groups);
 
         define_ct_int(private_globals.lookup(at, "_index"sv), at, TYPE_INT, i);
 
@@ -579,12 +575,9 @@ void convert_mapfab(mapfab_convert_type_t ct, std::uint8_t const* const begin, s
     {
         auto const& palette = mapfab.palettes[i];
 
-        ident_map_t<global_ht> private_globals;
-        if(base_private_globals)
-            private_globals = *base_private_globals;
-        ident_map_t<group_ht> private_groups;
-        if(base_private_groups)
-            private_groups = *base_private_groups;
+        // Each invocation gets its own private scope, layered on the base one.
+        ident_map_t<global_ht> private_globals(base_private_globals);
+        ident_map_t<group_ht> private_groups(base_private_groups);
 
         global_t& g = private_globals.lookup(at, "_palette"sv);
         define_ct(g, at, palette.data.data(), 25);
@@ -600,12 +593,9 @@ void convert_mapfab(mapfab_convert_type_t ct, std::uint8_t const* const begin, s
     {
         auto const& mt_set = mapfab.mt_sets[i];
 
-        ident_map_t<global_ht> private_globals;
-        if(base_private_globals)
-            private_globals = *base_private_globals;
-        ident_map_t<group_ht> private_groups;
-        if(base_private_groups)
-            private_groups = *base_private_groups;
+        // Each invocation gets its own private scope, layered on the base one.
+        ident_map_t<global_ht> private_globals(base_private_globals);
+        ident_map_t<group_ht> private_groups(base_private_groups);
 
         define_ct_int(private_globals.lookup(at, "_index"sv), at, TYPE_INT, i);
         define_ct_int(private_globals.lookup(at, "_num"sv), at, TYPE_INT, mt_set.num);
@@ -650,12 +640,9 @@ void convert_mapfab(mapfab_convert_type_t ct, std::uint8_t const* const begin, s
             return out;
         };
 
-        ident_map_t<global_ht> private_globals;
-        if(base_private_globals)
-            private_globals = *base_private_globals;
-        ident_map_t<group_ht> private_groups;
-        if(base_private_groups)
-            private_groups = *base_private_groups;
+        // Each invocation gets its own private scope, layered on the base one.
+        ident_map_t<global_ht> private_globals(base_private_globals);
+        ident_map_t<group_ht> private_groups(base_private_groups);
 
         define_ct_int(private_globals.lookup(at, "_index"sv), at, TYPE_INT, i);
         define_ct_int(private_globals.lookup(at, "_width"sv), at, TYPE_INT, level.w);
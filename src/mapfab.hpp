@@ -2,6 +2,7 @@
 #define MAPFAB_HPP
 
 #include <cstdint>
+#include <memory>
 
 #include "pstring.hpp"
 
@@ -31,7 +32,7 @@ class group_ht;
 
 void convert_mapfab(mapfab_convert_type_t ct, std::uint8_t const* const begin, std::size_t size, 
                     lpstring_t at, fs::path mapfab_path, mapfab_macros_t const& macros,
-                    ident_map_t<global_ht>* private_globals,
-                    ident_map_t<group_ht>* private_groups);
+                    std::shared_ptr<ident_map_t<global_ht> const> base_private_globals,
+                    std::shared_ptr<ident_map_t<group_ht> const> base_private_groups);
 
 #endif
@@ -1,5 +1,8 @@
 #include "mlb.hpp"
 
+#include <algorithm>
+#include <vector>
+
 #include "robin/map.hpp"
 
 #include "decl.hpp"
@@ -19,8 +22,21 @@ void print_mlb(std::ostream& o)
         return addr - mapper().bank_span(bank).addr + (bank * mapper().bank_size());
     };
 
+    // Handle order depends on the thread count, so sort to keep the file reproducible:
+    std::vector<fn_t const*> fns;
     for(fn_t const& fn : fn_ht::values())
+        fns.push_back(&fn);
+    std::sort(fns.begin(), fns.end(), [](fn_t const* a, fn_t const* b) { return global_t::stable_less(a->global, b->global); });
+
+    std::vector<const_t const*> consts;
+    for(const_t const& c : const_ht::values())
+        consts.push_back(&c);
+    std::sort(consts.begin(), consts.end(), [](const_t const* a, const_t const* b) { return global_t::stable_less(a->global, b->global); });
+
+    for(fn_t const* fn_ptr : fns)
     {
+        fn_t const& fn = *fn_ptr;
+
         for(unsigned romv = 0; romv < NUM_ROMV; ++romv)
         {
             if(auto a = fn.rom_proc()->get_alloc(romv_t(romv)))
@@ -36,7 +52,7 @@ void print_mlb(std::ostream& o)
 
                     o << fmt("NesPrgRom:%:%@%_%:\n", 
                              hex_string(begin, 6),
-                             fn.global.name, bank, romv);
+                             fn.qualified_name(), bank, romv);
 
                     locator_t const linked = locator_t::fn(fn.handle()).link(romv_t(romv), fn.handle(), -1);
                     
@@ -52,14 +68,16 @@ void print_mlb(std::ostream& o)
 
                     o << fmt("NesPrgRom:%:%@%_%_entry:\n", 
                              hex_string(addr, 6),
-                             fn.global.name, bank, romv);
+                             fn.qualified_name(), bank, romv);
                 });
             }
         }
     }
 
-    for(const_t const& c : const_ht::values())
+    for(const_t const* c_ptr : consts)
     {
+        const_t const& c = *c_ptr;
+
         for(unsigned romv = 0; romv < NUM_ROMV; ++romv)
         {
             if(!c.rom_array())
@@ -133,8 +151,13 @@ void print_mlb(std::ostream& o)
         });
     };
 
+    std::vector<gvar_t const*> gvars;
     for(gvar_t const& v : gvar_ht::values())
-        write_gvar(v);
+        gvars.push_back(&v);
+    std::sort(gvars.begin(), gvars.end(), [](gvar_t const* a, gvar_t const* b) { return global_t::stable_less(a->global, b->global); });
+
+    for(gvar_t const* v : gvars)
+        write_gvar(*v);
 
     for(unsigned i = 0; i < NUM_RTRAM; ++i)
     {
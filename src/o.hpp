@@ -9,6 +9,7 @@
 #include "o_motion.hpp"
 #include "o_arg.hpp"
 #include "o_id.hpp"
+#include "o_mul.hpp"
 #include "o_loop.hpp"
 #include "o_defork.hpp"
 #include "o_shift.hpp"
@@ -1176,115 +1176,8 @@ static bool o_simple_identity(log_t* log, ir_t& ir)
                     }
                 }
 
-                if(ssa_it->op() != SSA_mul)
-                {
-                done_mul:
-                    break;
-                }
-
-                // Convert to shifts
-                for(unsigned i = 0; i < 2; ++i)
-                {
-                    ssa_value_t const input = ssa_it->input(i);
-                    ssa_value_t const other = ssa_it->input(!i);
-
-                    if(!input.is_num())
-                        continue;
-
-                    fixed_sint_t const f = input.signed_fixed();
-                    fixed_uint_t const abs = std::abs(f);
-                    assert(f); // handled earlier
-                    
-                    // Multiplications will turn into the sum or difference of several shifts.
-                    // The code below determines whether it's more efficient to add or subtract.
-
-                    fixed_uint_t add = abs;
-                    fixed_uint_t sub = 0;
-
-                    bitset_for_each(abs, [&](unsigned bit)
-                    {
-                        fixed_uint_t const new_add = add + (1ull << bit);
-                        if(builtin::popcount(new_add) + 1 < builtin::popcount(add))
-                        {
-                            add = new_add;
-                            sub |= (1ull << bit);
-                        }
-                    });
-
-                    assert(!(add & sub));
-
-                    // Before generating the shifts and adds,
-                    // convert the operand to the resulting type,
-                    // and change the sign if necessary.
-
-                    cfg_ht const cfg = ssa_it->cfg_node();
-                    type_t const type = ssa_it->type();
-
-                    ssa_ht initial = cfg->emplace_ssa(SSA_cast, type, other);
-
-                    if(f < 0)
-                    {
-                        initial = cfg->emplace_ssa(
-                            SSA_sub, type, 
-                            ssa_value_t(0, type.name()), initial, ssa_value_t(1, TYPE_BOOL));
-                    }
-
-                    // Now generate the other SSA nodes
-
-                    ssa_value_t total = ssa_value_t(0u, type.name());
-                    ssa_ht shift = initial;
-                    unsigned prev_bit = 0;
-
-                    // Whole component:
-                    bitset_for_each((add | sub) >> fixed_t::shift, [&](unsigned bit)
-                    {
-                        unsigned const shift_amount = bit - prev_bit;
-
-                        bool const is_add = (1ull << bit) & (add >> fixed_t::shift);
-
-                        ssa_ht const next_shift = 
-                            shift_amount ? cfg->emplace_ssa(SSA_shl, type, shift, ssa_value_t(shift_amount, TYPE_U)) 
-                                         : shift;
-                        ssa_ht const next_total = 
-                            cfg->emplace_ssa(is_add ? SSA_add : SSA_sub, type, 
-                                             total, next_shift, ssa_value_t(!is_add, TYPE_BOOL));
-
-                        shift = next_shift;
-                        total = next_total;
-                        prev_bit = bit;
-                    });
-
-                    // Fractional component:
-                    if((add | sub) & ((1ull << fixed_t::shift)-1))
-                    {
-                        shift = initial;
-                        prev_bit = fixed_t::shift;
-
-                        for(unsigned bit = fixed_t::shift-1; bit < fixed_t::shift; --bit)
-                        {
-                            if(!((add | sub) & (1 << bit)))
-                                continue;
-
-                            bool const is_add = (1ull << bit) & add;
-
-                            unsigned const shift_amount = prev_bit - bit;
-                            passert(shift_amount, prev_bit, bit);
-
-                            ssa_ht const next_shift = 
-                                cfg->emplace_ssa(SSA_shr, type, shift, ssa_value_t(shift_amount, TYPE_U));
-                            ssa_ht const next_total = 
-                                cfg->emplace_ssa(is_add ? SSA_add : SSA_sub, type, 
-                                                 total, next_shift, ssa_value_t(!is_add, TYPE_BOOL));
-
-                            shift = next_shift;
-                            total = next_total;
-                            prev_bit = bit;
-                        }
-                    }
-
-                    ssa_it->replace_with(total);
-                    goto prune;
-                }
+                // Multiplications by other constants are handled by 'o_mul_constants'.
+            done_mul:
                 break;
 
             default:
@@ -676,7 +676,7 @@ bool rewrite_loop(bool is_do, bool is_byteified, iv_t& root,
 }
 
 // Returns times unrolled, or 0 if nothing happened.
-fixed_sint_t unroll_loop(cfg_ht header, fixed_sint_t iterations, bool sloppy)
+fixed_sint_t unroll_loop(cfg_ht header, fixed_sint_t iterations, bool sloppy, unsigned max_cost)
 {
     if(header->test_flags(FLAG_NO_UNROLL))
         return 0;
@@ -696,7 +696,6 @@ fixed_sint_t unroll_loop(cfg_ht header, fixed_sint_t iterations, bool sloppy)
     if(!header->test_flags(FLAG_UNLOOP))
     {
         // Estimate the cost of each loop iteration.
-        constexpr unsigned MAX_COST = 64;
         unsigned cost_per_iter = 0;
 
         auto const calc_cost_per_iter = [&](cfg_ht cfg)
@@ -706,7 +705,7 @@ fixed_sint_t unroll_loop(cfg_ht header, fixed_sint_t iterations, bool sloppy)
                 if(ssa != hd.simple_condition && ssa != hd.simple_branch)
                 {
                     cost_per_iter += estimate_cost(*ssa);
-                    if(cost_per_iter > MAX_COST / 2)
+                    if(cost_per_iter > max_cost / 2)
                         return false;
                 }
             }
@@ -723,7 +722,7 @@ fixed_sint_t unroll_loop(cfg_ht header, fixed_sint_t iterations, bool sloppy)
         if(cost_per_iter == 0)
             return 0;
 
-        unroll_amount = estimate_unroll_divisor(iterations, MAX_COST / cost_per_iter);
+        unroll_amount = estimate_unroll_divisor(iterations, max_cost / cost_per_iter);
     }
     passert(iterations % unroll_amount == 0, iterations, unroll_amount);
 
@@ -854,7 +853,7 @@ fixed_sint_t unroll_loop(cfg_ht header, fixed_sint_t iterations, bool sloppy)
     return unroll_amount;
 }
 
-bool initial_loop_processing(log_t* log, ir_t& ir, bool is_byteified, bool sloppy)
+bool initial_loop_processing(log_t* log, ir_t& ir, bool is_byteified, bool sloppy, unsigned max_unroll_cost)
 {
     bool updated = false;
 
@@ -1354,7 +1353,7 @@ bool initial_loop_processing(log_t* log, ir_t& ir, bool is_byteified, bool slopp
                 }
             }
 
-            if(fixed_sint_t unroll_amount = unroll_loop(header, iterations, sloppy))
+            if(fixed_sint_t unroll_amount = unroll_loop(header, iterations, sloppy, max_unroll_cost))
             {
                 dprint(log, "UNROLLED", unroll_amount);
                 iterations /= unroll_amount;
@@ -1412,7 +1411,7 @@ bool initial_loop_processing(log_t* log, ir_t& ir, bool is_byteified, bool slopp
 // LOOP //
 //////////
 
-bool o_loop(log_t* log, ir_t& ir, bool is_byteified, bool sloppy)
+bool o_loop(log_t* log, ir_t& ir, bool is_byteified, bool sloppy, unsigned max_unroll_cost)
 {
     build_loops_and_order(ir);
     build_dominators_from_order(ir);
@@ -1428,7 +1427,7 @@ bool o_loop(log_t* log, ir_t& ir, bool is_byteified, bool sloppy)
 
     ssa_data_pool::scope_guard_t<ssa_loop_d> ssa_sg(ssa_pool::array_size());
 
-    updated |= initial_loop_processing(log, ir, is_byteified, sloppy);
+    updated |= initial_loop_processing(log, ir, is_byteified, sloppy, max_unroll_cost);
 
     return updated;
 }
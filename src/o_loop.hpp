@@ -4,6 +4,7 @@
 #include "debug_print.hpp"
 #include "ir_decl.hpp"
 
-bool o_loop(log_t* log, ir_t& ir, bool is_byteified, bool sloppy);
+// 'max_unroll_cost' bounds the estimated size of unrolled loop bodies.
+bool o_loop(log_t* log, ir_t& ir, bool is_byteified, bool sloppy, unsigned max_unroll_cost);
 
 #endif
@@ -0,0 +1,217 @@
+#include "o_mul.hpp"
+
+#include <boost/container/small_vector.hpp>
+
+#include "bitset.hpp"
+#include "builtin.hpp"
+#include "ir.hpp"
+#include "ssa_cost.hpp"
+#include "type.hpp"
+
+namespace bc = ::boost::container;
+
+namespace // anonymous
+{
+
+// A constant multiplier, written as the sum and difference of powers of two.
+struct mul_terms_t
+{
+    fixed_uint_t add;
+    fixed_uint_t sub;
+};
+
+// Subtracting a power of two can replace a run of added ones.
+// e.g. 'x * 7' becomes '(x << 3) - x' rather than '(x << 2) + (x << 1) + x'.
+mul_terms_t recode_terms(fixed_uint_t abs)
+{
+    fixed_uint_t add = abs;
+    fixed_uint_t sub = 0;
+
+    bitset_for_each(abs, [&](unsigned bit)
+    {
+        fixed_uint_t const new_add = add + (1ull << bit);
+        if(builtin::popcount(new_add) + 1 < builtin::popcount(add))
+        {
+            add = new_add;
+            sub |= (1ull << bit);
+        }
+    });
+
+    assert(!(add & sub));
+    return { add, sub };
+}
+
+// Calls 'fn(shift_op, amount, is_add)' for each term, in the order they're generated.
+// Each term shifts the previous term, except the first fractional term, which shifts the original value.
+template<typename Fn>
+void for_each_term(mul_terms_t terms, Fn const& fn)
+{
+    fixed_uint_t const all = terms.add | terms.sub;
+    unsigned prev_bit = 0;
+
+    // Whole component:
+    bitset_for_each(all >> fixed_t::shift, [&](unsigned bit)
+    {
+        bool const is_add = (1ull << bit) & (terms.add >> fixed_t::shift);
+        fn(SSA_shl, bit - prev_bit, is_add);
+        prev_bit = bit;
+    });
+
+    // Fractional component:
+    prev_bit = fixed_t::shift;
+    for(unsigned bit = fixed_t::shift-1; bit < fixed_t::shift; --bit)
+    {
+        if(!(all & (1ull << bit)))
+            continue;
+
+        bool const is_add = (1ull << bit) & terms.add;
+        fn(SSA_shr, prev_bit - bit, is_add);
+        prev_bit = bit;
+    }
+}
+
+ssa_cost_t terms_cost(mul_terms_t terms, bool negate, unsigned width)
+{
+    ssa_cost_t cost = {};
+
+    if(negate)
+        cost += estimate_ssa_cost(SSA_sub, width);
+
+    bool first = true;
+    for_each_term(terms, [&](ssa_op_t, unsigned amount, bool is_add)
+    {
+        if(amount)
+            cost += estimate_shift_cost(width, amount);
+
+        // Adding the first term to zero is free.
+        if(!first || !is_add)
+            cost += estimate_ssa_cost(is_add ? SSA_add : SSA_sub, width);
+        first = false;
+    });
+
+    return cost;
+}
+
+// Estimates the multiply that 'byteify' would generate,
+// skipping bytes of the constant that are zero or one.
+ssa_cost_t mul_cost(ssa_value_t constant, type_t other_type, unsigned width, bool mul_table)
+{
+    type_name_t const tn = constant.type().name();
+    fixed_uint_t const value = constant.fixed().value;
+    unsigned const other_bytes = total_bytes(other_type.name());
+
+    unsigned products = 0;
+    unsigned partials = 0;
+
+    for(unsigned i = begin_byte(tn); i < end_byte(tn); ++i)
+    {
+        std::uint8_t const byte = value >> (i * 8);
+        if(byte == 0)
+            continue;
+        if(byte != 1)
+            products += other_bytes;
+        partials += other_bytes;
+    }
+
+    ssa_cost_t cost = estimate_mul8_cost(mul_table) * products;
+    if(partials > 1)
+        cost += estimate_ssa_cost(SSA_add, width) * (partials - 1);
+    return cost;
+}
+
+} // end anonymous namespace
+
+bool o_mul_constants(log_t* log, ir_t& ir, heat_t heat, bool mul_table)
+{
+    bool updated = false;
+
+    unsigned const cycle_bytes = heat_cycle_bytes(heat);
+    auto const score = [&](ssa_cost_t cost) { return cost.cycles * cycle_bytes + cost.bytes; };
+
+    bc::small_vector<ssa_ht, 8> muls;
+
+    for(cfg_ht cfg_it = ir.cfg_begin(); cfg_it; ++cfg_it)
+    for(ssa_ht ssa_it = cfg_it->ssa_begin(); ssa_it; ++ssa_it)
+        if(ssa_it->op() == SSA_mul)
+            muls.push_back(ssa_it);
+
+    for(ssa_ht const ssa_it : muls)
+    for(unsigned i = 0; i < 2; ++i)
+    {
+        ssa_value_t const input = ssa_it->input(i);
+        ssa_value_t const other = ssa_it->input(!i);
+
+        if(!input.is_num())
+            continue;
+
+        fixed_sint_t const f = input.signed_fixed();
+        fixed_uint_t const abs = std::abs(f);
+        if(!f)
+            break; // 'o_identities' handles this.
+
+        cfg_ht const cfg = ssa_it->cfg_node();
+        type_t const type = ssa_it->type();
+        unsigned const width = total_bytes(type.name());
+
+        // Pick whichever of the plain or recoded terms is cheaper,
+        // then compare against multiplying.
+
+        mul_terms_t const plain = { abs, 0 };
+        mul_terms_t const recoded = recode_terms(abs);
+
+        ssa_cost_t const plain_cost = terms_cost(plain, f < 0, width);
+        ssa_cost_t const recoded_cost = terms_cost(recoded, f < 0, width);
+
+        bool const use_recoded = score(recoded_cost) < score(plain_cost);
+        mul_terms_t const terms = use_recoded ? recoded : plain;
+        ssa_cost_t const cost = use_recoded ? recoded_cost : plain_cost;
+
+        ssa_cost_t const mul = mul_cost(input, other.type(), width, mul_table);
+
+        dprint(log, "MUL_CONSTANTS", ssa_it, f, score(cost), score(mul));
+
+        if(score(cost) > score(mul))
+            break;
+
+        // Before generating the shifts and adds,
+        // convert the operand to the resulting type,
+        // and change the sign if necessary.
+
+        ssa_ht initial = cfg->emplace_ssa(SSA_cast, type, other);
+
+        if(f < 0)
+        {
+            initial = cfg->emplace_ssa(
+                SSA_sub, type,
+                ssa_value_t(0, type.name()), initial, ssa_value_t(1, TYPE_BOOL));
+        }
+
+        // Now generate the other SSA nodes
+
+        ssa_value_t total = ssa_value_t(0u, type.name());
+        ssa_ht shift = initial;
+        ssa_op_t prev_op = SSA_shl;
+
+        for_each_term(terms, [&](ssa_op_t shift_op, unsigned amount, bool is_add)
+        {
+            // Fractional terms start over from the original value.
+            if(shift_op != prev_op)
+                shift = initial;
+            prev_op = shift_op;
+
+            if(amount)
+                shift = cfg->emplace_ssa(shift_op, type, shift, ssa_value_t(amount, TYPE_U));
+
+            total = cfg->emplace_ssa(is_add ? SSA_add : SSA_sub, type,
+                                     total, shift, ssa_value_t(!is_add, TYPE_BOOL));
+        });
+
+        ssa_it->replace_with(total);
+        ssa_it->prune();
+
+        updated = true;
+        break;
+    }
+
+    return updated;
+}
@@ -0,0 +1,13 @@
+#ifndef O_MUL_HPP
+#define O_MUL_HPP
+
+#include "debug_print.hpp"
+#include "ir_decl.hpp"
+#include "profile.hpp"
+
+// Replaces multiplications by constants with shifts, additions, and subtractions,
+// when doing so is cheaper than calling the runtime's multiply.
+// 'heat' weighs speed against size, while 'mul_table' tells which multiply is used.
+bool o_mul_constants(log_t* log, ir_t& ir, heat_t heat, bool mul_table);
+
+#endif
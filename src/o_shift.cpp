@@ -2,6 +2,13 @@
 
 #include "ir.hpp"
 #include "runtime.hpp"
+#include "ssa_cost.hpp"
+
+// Masking the input, then indexing the table:
+static ssa_cost_t shl_table_cost()
+{
+    return estimate_ssa_cost(SSA_and, 1, true) + estimate_ssa_cost(SSA_shl_table, 1);
+}
 
 bool o_shl_tables(log_t* log, ir_t& ir)
 {
@@ -35,7 +42,8 @@ bool o_shl_tables(log_t* log, ir_t& ir)
 
             modified = true;
         }
-        else if(amount >= MIN_SHL_TABLE && amount <= MAX_SHL_TABLE)
+        else if(amount >= MIN_SHL_TABLE && amount <= MAX_SHL_TABLE
+                && shl_table_cost().weight() < estimate_shift_cost(1, amount).weight())
         {
             // When using the tables, we have to mask the input to be in bounds.
             unsigned const mask = 0xFF >> amount;
@@ -24,6 +24,7 @@ struct options_t
 {
     int num_threads = 1;
     int time_limit = 1000;
+    int isel_budget = 0; // Per-function instruction selection budget, in thousands of selections. 0 is off.
     bool graphviz = false;
     bool ir_info = false;
     bool ram_info = false;
@@ -34,7 +35,11 @@ struct options_t
     bool unsafe_bank_switch = false;
     bool assert_valid = true;
     bool sloppy = false;
+    bool mul_table = false;
     bool action53 = false;
+    bool verify_determinism = false;
+    bool bank_affinity = false;
+    bool lean = false;
 
     bool ram_init = false;
     bool sram_init = false;
@@ -50,6 +55,12 @@ struct options_t
     std::string raw_mlb;
     std::string raw_ctags;
 
+    // Emulator profile, for profile-guided optimization:
+    std::string raw_profile;
+
+    // Trace of the compiler's own work, for performance analysis:
+    std::string raw_trace;
+
     nes_system_t nes_system = NES_SYSTEM_UNKNOWN;
     std::string raw_system;
 
@@ -246,10 +246,10 @@ public:
         {
         default:      return 0;
         case FN_CT:   return 0;
-        case FN_FN:   return MOD_zero_page | MOD_align | MOD_inline | MOD_graphviz | MOD_static | MOD_info | MOD_sloppy;
-        case FN_MODE: return MOD_zero_page | MOD_align | MOD_graphviz | MOD_static | MOD_info | MOD_sloppy;
-        case FN_NMI:  return MOD_zero_page | MOD_align | MOD_graphviz | MOD_static | MOD_info | MOD_sloppy;
-        case FN_IRQ:  return MOD_zero_page | MOD_align | MOD_graphviz | MOD_static | MOD_info | MOD_sloppy | MOD_solo_interrupt;
+        case FN_FN:   return MOD_zero_page | MOD_align | MOD_inline | MOD_graphviz | MOD_static | MOD_info | MOD_sloppy | MOD_mul_table;
+        case FN_MODE: return MOD_zero_page | MOD_align | MOD_graphviz | MOD_static | MOD_info | MOD_sloppy | MOD_mul_table;
+        case FN_NMI:  return MOD_zero_page | MOD_align | MOD_graphviz | MOD_static | MOD_info | MOD_sloppy | MOD_mul_table;
+        case FN_IRQ:  return MOD_zero_page | MOD_align | MOD_graphviz | MOD_static | MOD_info | MOD_sloppy | MOD_mul_table | MOD_solo_interrupt;
         }
     }
 
@@ -1119,7 +1119,11 @@ public:
             try 
             { 
                 if(mod_test(tm.mods.get(), MOD_fork_scope))
-                    invoke_macro(std::move(tm.invoke), private_globals, private_groups); 
+                {
+                    invoke_macro(std::move(tm.invoke), 
+                                 ident_map_t<global_ht>(private_globals.share()), 
+                                 ident_map_t<group_ht>(private_groups.share())); 
+                }
                 else
                     invoke_macro(std::move(tm.invoke)); 
             }
@@ -1330,13 +1334,13 @@ public:
         {
             try 
             { 
-                ident_map_t<global_ht>* private_globals = nullptr;
-                ident_map_t<group_ht>* private_groups = nullptr;
+                std::shared_ptr<ident_map_t<global_ht> const> private_globals;
+                std::shared_ptr<ident_map_t<group_ht> const> private_groups;
 
                 if(mod_test(tm.mods.get(), MOD_fork_scope))
                 {
-                    private_globals = &this->private_globals;
-                    private_groups = &this->private_groups;
+                    private_globals = this->private_globals.share();
+                    private_groups = this->private_groups.share();
                 }
 
                 convert_mapfab(tm.ct, tm.data.data(), tm.data.size(), tm.at, std::move(tm.path), 
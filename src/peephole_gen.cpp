@@ -0,0 +1,639 @@
+// Offline superoptimizer that generates the rule table used by 'o_peephole'.
+//
+// Every pair of instructions over a single memory operand 'M' and a single
+// immediate operand 'K' is enumerated, alongside all shorter sequences.
+// Sequences are bucketed by their outputs on a fixed set of CPU states,
+// and each bucket is searched for cheaper sequences that behave the same.
+// Candidates are then checked against a much larger set of CPU states
+// before becoming a rule.
+//
+// Build and run with 'make peephole_rules', which rewrites 'peephole_rules.inc'.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "asm.hpp"
+#include "fnv1a.hpp"
+
+namespace
+{
+
+constexpr std::uint8_t FLAG_C = 1 << 0;
+constexpr std::uint8_t FLAG_Z = 1 << 1;
+constexpr std::uint8_t FLAG_V = 1 << 6;
+constexpr std::uint8_t FLAG_N = 1 << 7;
+constexpr std::uint8_t FLAGS = FLAG_C | FLAG_Z | FLAG_V | FLAG_N;
+
+struct cpu_state_t
+{
+    std::uint8_t a, x, y, p, m, k;
+
+    bool operator==(cpu_state_t const& o) const
+    {
+        return a == o.a && x == o.x && y == o.y && m == o.m
+            && (p & FLAGS) == (o.p & FLAGS);
+    }
+};
+
+enum arg_t : std::uint8_t
+{
+    ARG_NONE,
+    ARG_K, // The symbolic immediate operand.
+    ARG_M, // The symbolic memory operand.
+    ARG_CONST, // A specific immediate value.
+};
+
+struct variant_t
+{
+    op_t op;
+    arg_t arg;
+    std::uint8_t value; // For ARG_CONST
+};
+
+constexpr std::uint8_t const_values[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF };
+
+struct seq_t
+{
+    std::uint8_t size;
+    std::array<variant_t, 2> code;
+
+    unsigned cycles() const
+    {
+        unsigned ret = 0;
+        for(unsigned i = 0; i < size; ++i)
+            ret += op_cycles(code[i].op);
+        return ret;
+    }
+
+    unsigned bytes() const
+    {
+        unsigned ret = 0;
+        for(unsigned i = 0; i < size; ++i)
+            ret += op_size(code[i].op);
+        return ret;
+    }
+
+    bool illegal() const
+    {
+        for(unsigned i = 0; i < size; ++i)
+            if(op_illegal(code[i].op))
+                return true;
+        return false;
+    }
+
+    bool uses(arg_t arg) const
+    {
+        for(unsigned i = 0; i < size; ++i)
+            if(code[i].arg == arg)
+                return true;
+        return false;
+    }
+
+    regs_t input_regs() const
+    {
+        regs_t ret = 0;
+        for(unsigned i = 0; i < size; ++i)
+            ret |= op_input_regs(code[i].op);
+        return ret;
+    }
+};
+
+// Models the NES's CPU, which lacks decimal mode.
+// Returns false for ops that aren't modeled.
+bool execute(variant_t v, cpu_state_t& s)
+{
+    std::uint8_t operand = 0;
+    switch(v.arg)
+    {
+    case ARG_NONE: break;
+    case ARG_K: operand = s.k; break;
+    case ARG_M: operand = s.m; break;
+    case ARG_CONST: operand = v.value; break;
+    }
+
+    auto const set_nz = [&](std::uint8_t r)
+    {
+        s.p = (s.p & ~(FLAG_N | FLAG_Z)) | (r & FLAG_N) | (r ? 0 : FLAG_Z);
+    };
+
+    auto const set_c = [&](bool c) { s.p = (s.p & ~FLAG_C) | (c ? FLAG_C : 0); };
+    auto const set_v = [&](bool v) { s.p = (s.p & ~FLAG_V) | (v ? FLAG_V : 0); };
+
+    auto const adc = [&](std::uint8_t o)
+    {
+        unsigned const r = s.a + o + (s.p & FLAG_C);
+        set_c(r > 0xFF);
+        set_v(~(s.a ^ o) & (s.a ^ r) & 0x80);
+        s.a = r;
+        set_nz(s.a);
+    };
+
+    auto const cmp = [&](std::uint8_t r, std::uint8_t o)
+    {
+        set_c(r >= o);
+        set_nz(r - o);
+    };
+
+    auto const asl = [&](std::uint8_t& r) { set_c(r & 0x80); r <<= 1; set_nz(r); };
+    auto const lsr = [&](std::uint8_t& r) { set_c(r & 0x01); r >>= 1; set_nz(r); };
+    auto const rol = [&](std::uint8_t& r)
+    {
+        bool const c = s.p & FLAG_C;
+        set_c(r & 0x80);
+        r = (r << 1) | c;
+        set_nz(r);
+    };
+    auto const ror = [&](std::uint8_t& r)
+    {
+        bool const c = s.p & FLAG_C;
+        set_c(r & 0x01);
+        r = (r >> 1) | (c << 7);
+        set_nz(r);
+    };
+
+    // Read-modify-write ops modify 'M', others modify 'A'.
+    std::uint8_t& rmw = v.arg == ARG_M ? s.m : s.a;
+
+    switch(op_name(v.op))
+    {
+    case ADC: adc(operand); break;
+    case SBC: adc(~operand); break;
+    case AND: s.a &= operand; set_nz(s.a); break;
+    case ORA: s.a |= operand; set_nz(s.a); break;
+    case EOR: s.a ^= operand; set_nz(s.a); break;
+    case CMP: cmp(s.a, operand); break;
+    case CPX: cmp(s.x, operand); break;
+    case CPY: cmp(s.y, operand); break;
+    case BIT:
+        s.p = (s.p & ~(FLAG_N | FLAG_V | FLAG_Z))
+            | (operand & (FLAG_N | FLAG_V))
+            | ((s.a & operand) ? 0 : FLAG_Z);
+        break;
+    case ASL: asl(rmw); break;
+    case LSR: lsr(rmw); break;
+    case ROL: rol(rmw); break;
+    case ROR: ror(rmw); break;
+    case INC: ++s.m; set_nz(s.m); break;
+    case DEC: --s.m; set_nz(s.m); break;
+    case INX: ++s.x; set_nz(s.x); break;
+    case INY: ++s.y; set_nz(s.y); break;
+    case DEX: --s.x; set_nz(s.x); break;
+    case DEY: --s.y; set_nz(s.y); break;
+    case LDA: s.a = operand; set_nz(s.a); break;
+    case LDX: s.x = operand; set_nz(s.x); break;
+    case LDY: s.y = operand; set_nz(s.y); break;
+    case STA: s.m = s.a; break;
+    case STX: s.m = s.x; break;
+    case STY: s.m = s.y; break;
+    case TAX: s.x = s.a; set_nz(s.x); break;
+    case TAY: s.y = s.a; set_nz(s.y); break;
+    case TXA: s.a = s.x; set_nz(s.a); break;
+    case TYA: s.a = s.y; set_nz(s.a); break;
+    case CLC: set_c(false); break;
+    case SEC: set_c(true); break;
+    case CLV: set_v(false); break;
+
+    // Illegal ops:
+    case LAX: s.a = s.x = operand; set_nz(s.a); break;
+    case SAX: s.m = s.a & s.x; break;
+    case DCP: --s.m; cmp(s.a, s.m); break;
+    case ISC: ++s.m; adc(~s.m); break;
+    case RLA: rol(s.m); s.a &= s.m; set_nz(s.a); break;
+    case RRA: ror(s.m); adc(s.m); break;
+    case SLO: asl(s.m); s.a |= s.m; set_nz(s.a); break;
+    case SRE: lsr(s.m); s.a ^= s.m; set_nz(s.a); break;
+    case ANC: s.a &= operand; set_nz(s.a); set_c(s.a & 0x80); break;
+    case ALR: s.a &= operand; lsr(s.a); break;
+    case ARR:
+        s.a = ((s.a & operand) >> 1) | ((s.p & FLAG_C) << 7);
+        set_nz(s.a);
+        set_c(s.a & 0x40);
+        set_v(((s.a >> 6) ^ (s.a >> 5)) & 1);
+        break;
+    case AXS:
+        {
+            std::uint8_t const r = s.a & s.x;
+            set_c(r >= operand);
+            s.x = r - operand;
+            set_nz(s.x);
+        }
+        break;
+
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+cpu_state_t run(seq_t const& seq, cpu_state_t s)
+{
+    for(unsigned i = 0; i < seq.size; ++i)
+        execute(seq.code[i], s);
+    return s;
+}
+
+// Checks that 'execute' only touches what 'asm_tables.hpp' says the op does.
+bool matches_tables(variant_t v, std::vector<cpu_state_t> const& tests)
+{
+    regs_t const output = op_output_regs(v.op);
+
+    for(cpu_state_t before : tests)
+    {
+        cpu_state_t after = before;
+        if(!execute(v, after))
+            return false;
+
+        if((after.a != before.a && !(output & REGF_A))
+           || (after.x != before.x && !(output & REGF_X))
+           || (after.y != before.y && !(output & REGF_Y))
+           || (after.m != before.m && !(output & REGF_M))
+           || ((after.p ^ before.p) & FLAG_C && !(output & REGF_C))
+           || ((after.p ^ before.p) & FLAG_Z && !(output & REGF_Z))
+           || ((after.p ^ before.p) & FLAG_V && !(output & REGF_V))
+           || ((after.p ^ before.p) & FLAG_N && !(output & REGF_N)))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::vector<cpu_state_t> random_states(unsigned count, std::mt19937& rng)
+{
+    std::vector<cpu_state_t> ret(count);
+    for(cpu_state_t& s : ret)
+    {
+        s.a = rng();
+        s.x = rng();
+        s.y = rng();
+        s.p = rng() & FLAGS;
+        s.m = rng();
+        s.k = rng();
+    }
+    return ret;
+}
+
+// Compares two sequences on every edge-case value of their inputs,
+// plus a large number of random states.
+bool equivalent(seq_t const& a, seq_t const& b, std::vector<cpu_state_t> const& random)
+{
+    for(cpu_state_t const& s : random)
+        if(run(a, s) != run(b, s))
+            return false;
+
+    constexpr std::uint8_t edges[] = { 0x00, 0x01, 0x40, 0x7F, 0x80, 0x81, 0xC0, 0xFE, 0xFF };
+    constexpr unsigned num_edges = sizeof(edges);
+
+    regs_t const inputs = a.input_regs() | b.input_regs();
+    bool const flags = inputs & (REGF_C | REGF_Z | REGF_V | REGF_N);
+
+    unsigned const na = (inputs & REGF_A) ? num_edges : 1;
+    unsigned const nx = (inputs & REGF_X) ? num_edges : 1;
+    unsigned const ny = (inputs & REGF_Y) ? num_edges : 1;
+    unsigned const nm = (a.uses(ARG_M) || b.uses(ARG_M)) ? num_edges : 1;
+    unsigned const nk = (a.uses(ARG_K) || b.uses(ARG_K)) ? num_edges : 1;
+    unsigned const np = flags ? 16 : 1;
+
+    for(unsigned ia = 0; ia < na; ++ia)
+    for(unsigned ix = 0; ix < nx; ++ix)
+    for(unsigned iy = 0; iy < ny; ++iy)
+    for(unsigned im = 0; im < nm; ++im)
+    for(unsigned ik = 0; ik < nk; ++ik)
+    for(unsigned ip = 0; ip < np; ++ip)
+    {
+        cpu_state_t const s =
+        {
+            .a = edges[ia],
+            .x = edges[ix],
+            .y = edges[iy],
+            .p = std::uint8_t((ip & 3) | ((ip & 0b1100) << 4)),
+            .m = edges[im],
+            .k = edges[ik],
+        };
+
+        if(run(a, s) != run(b, s))
+            return false;
+    }
+
+    return true;
+}
+
+bool cheaper(seq_t const& a, seq_t const& b)
+{
+    unsigned const ac = a.cycles(), bc = b.cycles();
+    unsigned const as = a.bytes(), bs = b.bytes();
+    return ac <= bc && as <= bs && (ac < bc || as < bs);
+}
+
+// Orders candidate replacements, best first.
+bool better(seq_t const& a, seq_t const& b)
+{
+    return std::make_tuple(a.cycles(), a.bytes(), a.illegal(), a.size)
+         < std::make_tuple(b.cycles(), b.bytes(), b.illegal(), b.size);
+}
+
+enum rule_kind_t
+{
+    RULE_ANY,
+    RULE_LEGAL, // Only for builds limited to legal ops.
+    RULE_ILLEGAL, // Only for builds allowing illegal ops.
+};
+
+struct rule_t
+{
+    seq_t match;
+    seq_t replace;
+    rule_kind_t kind;
+};
+
+// Where a replacement instruction's operand comes from.
+char const* arg_source(seq_t const& match, variant_t v)
+{
+    if(v.arg == ARG_NONE)
+        return "PEEP_NONE";
+    if(v.arg == ARG_CONST)
+        return "PEEP_CONST";
+    return match.code[0].arg == v.arg ? "PEEP_A" : "PEEP_B";
+}
+
+void print_rule(char const* macro, rule_t const& rule)
+{
+    auto const match_const = [&](variant_t v) -> int
+        { return v.arg == ARG_CONST ? v.value : -1; };
+
+    seq_t const& m = rule.match;
+    seq_t const& r = rule.replace;
+
+    bool const same_arg = m.code[0].arg != ARG_NONE && m.code[0].arg != ARG_CONST
+                          && m.code[0].arg == m.code[1].arg;
+
+    std::printf("%s(%s, %i, %s, %i, %i, ", macro,
+                to_string(m.code[0].op).c_str(), match_const(m.code[0]),
+                to_string(m.code[1].op).c_str(), match_const(m.code[1]),
+                same_arg);
+
+    for(unsigned i = 0; i < 2; ++i)
+    {
+        if(i < r.size)
+            std::printf("%s, %s, %i", to_string(r.code[i].op).c_str(),
+                        arg_source(m, r.code[i]), r.code[i].value);
+        else
+            std::printf("ASM_PRUNED, PEEP_NONE, 0");
+        std::printf(i ? ")\n" : ", ");
+    }
+}
+
+} // end anonymous namespace
+
+int main()
+{
+    std::mt19937 rng(0x6502);
+    std::vector<cpu_state_t> const fingerprint_tests = random_states(32, rng);
+    std::vector<cpu_state_t> const verify_tests = random_states(4096, rng);
+
+    // Find the ops to search over:
+    std::vector<op_t> ops;
+    for(unsigned i = 0; i < NUM_NORMAL_OPS; ++i)
+    {
+        op_t const op = op_t(i);
+
+        if(op_flags(op) & (ASMF_FAKE | ASMF_BRANCH | ASMF_JUMP | ASMF_CALL
+                           | ASMF_RETURN | ASMF_IMPURE | ASMF_MAYBE_STORE))
+        {
+            continue;
+        }
+
+        switch(op_addr_mode(op))
+        {
+        case MODE_IMPLIED:
+        case MODE_IMMEDIATE:
+        case MODE_ZERO_PAGE:
+        case MODE_ABSOLUTE:
+            break;
+        default:
+            continue;
+        }
+
+        variant_t const v = { op, op_addr_mode(op) == MODE_IMPLIED ? ARG_NONE
+                                  : op_addr_mode(op) == MODE_IMMEDIATE ? ARG_K : ARG_M };
+        if(matches_tables(v, verify_tests))
+            ops.push_back(op);
+    }
+
+    std::vector<rule_t> rules;
+
+    for(addr_mode_t const mode : { MODE_ZERO_PAGE, MODE_ABSOLUTE })
+    {
+        std::vector<variant_t> variants;
+        for(op_t op : ops)
+        {
+            switch(op_addr_mode(op))
+            {
+            case MODE_IMPLIED:
+                variants.push_back({ op, ARG_NONE });
+                break;
+            case MODE_IMMEDIATE:
+                variants.push_back({ op, ARG_K });
+                for(std::uint8_t value : const_values)
+                    variants.push_back({ op, ARG_CONST, value });
+                break;
+            default:
+                if(op_addr_mode(op) == mode)
+                    variants.push_back({ op, ARG_M });
+                break;
+            }
+        }
+
+        std::vector<seq_t> seqs;
+        seqs.push_back({ 0 });
+        for(variant_t const& a : variants)
+        {
+            seqs.push_back({ 1, { a }});
+            for(variant_t const& b : variants)
+                seqs.push_back({ 2, { a, b }});
+        }
+
+        // Bucket sequences by their behavior:
+        std::unordered_map<std::uint64_t, std::vector<unsigned>> buckets;
+        for(unsigned i = 0; i < seqs.size(); ++i)
+        {
+            std::uint64_t hash = fnv1a<std::uint64_t>::seed;
+            for(cpu_state_t const& test : fingerprint_tests)
+            {
+                cpu_state_t const s = run(seqs[i], test);
+                for(std::uint8_t byte : { s.a, s.x, s.y, std::uint8_t(s.p & FLAGS), s.m })
+                    hash = fnv1a<std::uint64_t>::hash(byte, hash);
+            }
+            buckets[hash].push_back(i);
+        }
+
+        for(auto& pair : buckets)
+        {
+            std::vector<unsigned>& bucket = pair.second;
+            if(bucket.size() < 2)
+                continue;
+
+            std::sort(bucket.begin(), bucket.end(), [&](unsigned a, unsigned b)
+            {
+                if(better(seqs[a], seqs[b]))
+                    return true;
+                if(better(seqs[b], seqs[a]))
+                    return false;
+                return a < b;
+            });
+
+            for(unsigned i : bucket)
+            {
+                seq_t const& match = seqs[i];
+
+                // Only windows of two instructions are matched,
+                // and the ZERO_PAGE pass already found those without 'M'.
+                if(match.size != 2)
+                    continue;
+                if(mode == MODE_ABSOLUTE && !match.uses(ARG_M))
+                    continue;
+
+                // Find the best legal and illegal replacements:
+                seq_t const* best = nullptr;
+                seq_t const* best_legal = nullptr;
+
+                for(unsigned j : bucket)
+                {
+                    seq_t const& replace = seqs[j];
+
+                    // 'bucket' is sorted, so nothing after 'match' will be cheaper.
+                    if(j == i)
+                        break;
+
+                    if(!cheaper(replace, match))
+                        continue;
+
+                    if((replace.uses(ARG_K) && !match.uses(ARG_K))
+                       || (replace.uses(ARG_M) && !match.uses(ARG_M)))
+                    {
+                        continue;
+                    }
+
+                    if(best && (best_legal || replace.illegal()))
+                        continue;
+
+                    if(!equivalent(match, replace, verify_tests))
+                        continue;
+
+                    if(!best)
+                        best = &replace;
+                    if(!best_legal && !replace.illegal())
+                        best_legal = &replace;
+
+                    if(best_legal)
+                        break;
+                }
+
+                if(match.illegal())
+                {
+                    if(best)
+                        rules.push_back({ match, *best, RULE_ILLEGAL });
+                }
+                else if(best == best_legal)
+                {
+                    if(best)
+                        rules.push_back({ match, *best, RULE_ANY });
+                }
+                else
+                {
+                    rules.push_back({ match, *best, RULE_ILLEGAL });
+                    if(best_legal)
+                        rules.push_back({ match, *best_legal, RULE_LEGAL });
+                }
+            }
+        }
+    }
+
+    // Drop rules for constants that a rule for 'K' already covers:
+    auto const rule_key = [](seq_t const& m, rule_kind_t kind)
+    {
+        return std::make_tuple(m.code[0].op, m.code[0].arg, m.code[0].value,
+                               m.code[1].op, m.code[1].arg, m.code[1].value, kind);
+    };
+
+    std::map<decltype(rule_key(seq_t{}, RULE_ANY)), seq_t> by_match;
+    for(rule_t const& rule : rules)
+        by_match.emplace(rule_key(rule.match, rule.kind), rule.replace);
+
+    std::erase_if(rules, [&](rule_t const& rule)
+    {
+        seq_t const& m = rule.match;
+
+        for(unsigned i = 0; i < 2; ++i)
+        {
+            if(m.code[i].arg != ARG_CONST || m.code[!i].arg == ARG_K)
+                continue;
+
+            seq_t general = m;
+            general.code[i] = { m.code[i].op, ARG_K };
+
+            auto it = by_match.find(rule_key(general, rule.kind));
+            if(it == by_match.end() || it->second.size != rule.replace.size)
+                continue;
+
+            // Substitute the constant for 'K' and compare:
+            seq_t replace = it->second;
+            for(unsigned j = 0; j < replace.size; ++j)
+                if(replace.code[j].arg == ARG_K)
+                    replace.code[j] = { replace.code[j].op, ARG_CONST, m.code[i].value };
+
+            bool same = true;
+            for(unsigned j = 0; j < replace.size; ++j)
+            {
+                variant_t const& a = replace.code[j];
+                variant_t const& b = rule.replace.code[j];
+                same &= a.op == b.op && a.arg == b.arg && (a.arg != ARG_CONST || a.value == b.value);
+            }
+
+            if(same)
+                return true;
+        }
+
+        return false;
+    });
+
+    // Order by the matched ops, with the most specific rules first.
+    auto const key = [](rule_t const& rule)
+    {
+        seq_t const& m = rule.match;
+        return std::make_tuple(m.code[0].op, m.code[1].op,
+                               m.code[0].arg != ARG_CONST, m.code[1].arg != ARG_CONST,
+                               m.code[0].value, m.code[1].value,
+                               m.code[0].arg, m.code[1].arg,
+                               rule.kind);
+    };
+
+    std::sort(rules.begin(), rules.end(), [&](rule_t const& a, rule_t const& b)
+        { return key(a) < key(b); });
+
+    std::printf("// Generated by peephole_gen.cpp. Do not edit.\n");
+    std::printf("// Regenerate with 'make peephole_rules'.\n");
+    std::printf("// Fields: match ops and their constants (-1 for any), whether both operands must match,\n");
+    std::printf("//         then each replacement op, where its operand comes from, and its constant.\n\n");
+
+    for(rule_t const& rule : rules)
+    {
+        switch(rule.kind)
+        {
+        case RULE_ANY:     print_rule("PEEP", rule); break;
+        case RULE_LEGAL:   print_rule("PEEP_LEGAL", rule); break;
+        case RULE_ILLEGAL: print_rule("PEEP_ILLEGAL", rule); break;
+        }
+    }
+
+    std::fprintf(stderr, "%zu peephole rules\n", rules.size());
+}
@@ -0,0 +1,200 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "robin/map.hpp"
+
+#include "asm_proc.hpp"
+#include "format.hpp"
+#include "globals.hpp"
+#include "phase.hpp"
+#include "rom.hpp"
+
+namespace
+{
+    rh::batman_map<std::string, heat_t> heat_map;
+
+    // Functions accounting for this share of cycles are hot.
+    constexpr unsigned HOT_PERCENT = 90;
+
+    // Functions taking less than 1/COLD_DIVISOR of cycles are cold.
+    constexpr unsigned COLD_DIVISOR = 1000;
+
+    // Deeper loops aren't assumed to run any more often.
+    constexpr unsigned MAX_LOOP_DEPTH = 4;
+}
+
+void load_profile(std::string const& filename)
+{
+    assert(compiler_phase() < PHASE_PARSE);
+
+    std::ifstream ifs(filename);
+    if(!ifs)
+        throw std::runtime_error(fmt("Unable to open profile file %", filename));
+
+    rh::batman_map<std::string, std::uint64_t> cycle_map;
+
+    std::string line;
+    while(std::getline(ifs, line))
+    {
+        std::replace_if(line.begin(), line.end(), [](char c) { return c == ',' || c == ';'; }, ' ');
+
+        std::istringstream ss(line);
+        std::string label;
+        std::uint64_t cycles;
+        if(!(ss >> label >> cycles))
+            continue;
+
+        if(std::size_t const at = label.find('@'); at != std::string::npos)
+            label.resize(at);
+
+        if(!label.empty())
+            cycle_map[std::move(label)] += cycles;
+    }
+
+    std::vector<std::pair<std::uint64_t, std::string const*>> sorted;
+    std::uint64_t total = 0;
+    for(auto const& pair : cycle_map)
+    {
+        sorted.emplace_back(pair.second, &pair.first);
+        total += pair.second;
+    }
+
+    // Hottest first, using the name to break ties:
+    std::sort(sorted.begin(), sorted.end(), [](auto const& a, auto const& b)
+    {
+        if(a.first != b.first)
+            return a.first > b.first;
+        return *a.second < *b.second;
+    });
+
+    std::uint64_t accum = 0;
+    for(auto const& pair : sorted)
+    {
+        heat_t heat = HEAT_NORMAL;
+
+        if(accum * 100 < total * HOT_PERCENT)
+            heat = HEAT_HOT;
+        else if(pair.first * COLD_DIVISOR < total)
+            heat = HEAT_COLD;
+
+        accum += pair.first;
+        heat_map.insert({ *pair.second, heat });
+    }
+}
+
+heat_t profile_heat(std::string const& fn_name)
+{
+    assert(compiler_phase() >= PHASE_PARSE);
+
+    if(heat_t const* heat = heat_map.mapped(fn_name))
+        return *heat;
+    return HEAT_NORMAL;
+}
+
+std::vector<float> inst_frequencies(asm_proc_t const& proc)
+{
+    float const heat = proc.fn ? heat_frequency(proc.fn->heat()) : 1.0f;
+
+    std::vector<unsigned> const depths = proc.loop_depths();
+    std::vector<float> freqs(depths.size());
+
+    for(unsigned i = 0; i < depths.size(); ++i)
+        freqs[i] = std::pow(LOOP_ITERATIONS, std::min(depths[i], MAX_LOOP_DEPTH)) * heat;
+
+    return freqs;
+}
+
+fn_frequencies_t estimate_fn_frequencies()
+{
+    assert(compiler_phase() >= PHASE_ALLOC_RAM);
+
+    struct call_site_t
+    {
+        fn_ht caller;
+        float freq; // Calls per call of 'caller'
+    };
+
+    unsigned const num_fns = fn_ht::pool().size();
+
+    // Iterate in a stable order, keeping float sums deterministic:
+    std::vector<fn_ht> stable_fns;
+    for(fn_ht fn : fn_ht::handles())
+        stable_fns.push_back(fn);
+    std::sort(stable_fns.begin(), stable_fns.end(), [](fn_ht a, fn_ht b)
+        { return global_t::stable_less(a->global, b->global); });
+
+    // Indexed by callee:
+    std::vector<std::vector<call_site_t>> callers(num_fns);
+
+    for(fn_ht caller : stable_fns)
+    {
+        if(!caller->rom_proc())
+            continue;
+
+        asm_proc_t const& proc = caller->rom_proc()->asm_proc();
+        std::vector<float> const freqs = inst_frequencies(proc);
+
+        for(unsigned i = 0; i < proc.code.size(); ++i)
+        {
+            asm_inst_t const& inst = proc.code[i];
+
+            if(inst.arg.lclass() != LOC_FN || inst.alt)
+                continue;
+
+            if(unbanked_call_op(inst.op) == BAD_OP && inst.op != JSR_ABSOLUTE && inst.op != JMP_ABSOLUTE)
+                continue;
+
+            if(fn_ht const call = inst.arg.fn())
+                callers[call.id].push_back({ caller, freqs[i] });
+        }
+    }
+
+    // Propagate down the call graph, starting at modes, nmis, and irqs.
+
+    enum { UNVISITED, VISITING, DONE };
+    std::vector<std::uint8_t> state(num_fns);
+
+    fn_frequencies_t result;
+
+    for(unsigned romv = 0; romv < NUM_ROMV; ++romv)
+    {
+        std::vector<float>& freq = result[romv];
+        freq.resize(num_fns);
+        std::fill(state.begin(), state.end(), UNVISITED);
+
+        std::function<float(fn_ht)> calc_freq = [&](fn_ht fn) -> float
+        {
+            if(state[fn.id] == DONE)
+                return freq[fn.id];
+            if(state[fn.id] == VISITING)
+                return 0.0f; // Shouldn't happen, as recursion is disallowed.
+            state[fn.id] = VISITING;
+
+            float f = 0.0f;
+            if(fn->fclass == FN_MODE && romv == ROMV_MODE)
+                f += 1.0f / LOOP_ITERATIONS;
+            else if((fn->fclass == FN_NMI && romv == ROMV_NMI) || (fn->fclass == FN_IRQ && romv == ROMV_IRQ))
+                f += 1.0f;
+
+            for(call_site_t const& site : callers[fn.id])
+                f += calc_freq(site.caller) * site.freq;
+
+            state[fn.id] = DONE;
+            return freq[fn.id] = f;
+        };
+
+        for(fn_ht fn : stable_fns)
+            calc_freq(fn);
+    }
+
+    return result;
+}
@@ -0,0 +1,92 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+// Profile-guided optimization.
+// Cycle counts exported from an emulator are used to classify functions as hot or cold,
+// letting the optimizer spend more effort (and ROM) on the code that matters.
+//
+// The profile is a text file with one label per line, followed by its cycle count:
+//     main@0_0 123456
+// Labels are those written by the Mesen label file (see mlb.cpp),
+// meaning anything following '@' is ignored.
+// Fns in fn sets are labeled 'set__fn' (see fn_t::qualified_name), keeping labels unique.
+// Commas and semicolons are treated as whitespace, and unparsable lines are skipped.
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "rom_decl.hpp"
+
+class asm_proc_t;
+
+enum heat_t : char
+{
+    HEAT_NORMAL = 0, // Not profiled.
+    HEAT_COLD, // Rarely ran. Optimize for size.
+    HEAT_HOT, // Frequently ran. Optimize for speed.
+};
+
+void load_profile(std::string const& filename);
+heat_t profile_heat(std::string const& fn_name);
+
+// Bounds the estimated size of unrolled loops, in bytes.
+// (Cold functions only unroll when asked to.)
+constexpr unsigned heat_unroll_cost(heat_t heat)
+{
+    return heat == HEAT_HOT ? 256 : 128;
+}
+
+// Widens the instruction selection beam, as a power of 2.
+constexpr int heat_isel_widen(heat_t heat)
+{
+    return heat == HEAT_HOT ? 1 : 0;
+}
+
+// Hot functions are inlined more, cold functions less.
+constexpr unsigned heat_inline_size(heat_t heat, unsigned size)
+{
+    switch(heat)
+    {
+    default:        return size;
+    case HEAT_COLD: return size / 4;
+    case HEAT_HOT:  return size * 2;
+    }
+}
+
+// How many bytes of code are worth spending to save a cycle,
+// when choosing between implementations.
+constexpr unsigned heat_cycle_bytes(heat_t heat)
+{
+    switch(heat)
+    {
+    default:        return 4;
+    case HEAT_COLD: return 1;
+    case HEAT_HOT:  return 16;
+    }
+}
+
+// Without a profile, every loop is assumed to iterate this many times:
+constexpr float LOOP_ITERATIONS = 8.0f;
+
+// Scales how often code is estimated to run.
+constexpr float heat_frequency(heat_t heat)
+{
+    switch(heat)
+    {
+    default:        return 1.0f;
+    case HEAT_COLD: return 1.0f / LOOP_ITERATIONS;
+    case HEAT_HOT:  return LOOP_ITERATIONS;
+    }
+}
+
+// Estimates how many times each instruction of 'proc' runs per call,
+// based on loop depth and heat.
+std::vector<float> inst_frequencies(asm_proc_t const& proc);
+
+// Estimates how many times each fn is called per frame, indexed by romv and then fn id.
+// Modes are assumed to contain a loop running once per frame.
+using fn_frequencies_t = std::array<std::vector<float>, NUM_ROMV>;
+fn_frequencies_t estimate_fn_frequencies();
+
+#endif
@@ -4,7 +4,11 @@
 #include <iostream>
 #endif
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <cstring>
+#include <exception>
 #include <array>
 #include <vector>
 #include <map>
@@ -19,6 +23,8 @@
 #include "eternal_new.hpp"
 #include "thread.hpp"
 #include "define.hpp"
+#include "options.hpp"
+#include "file.hpp"
 
 using penguin_pattern_t = std::vector<std::uint8_t>;
 using asm_vec_t = std::vector<asm_inst_t>;
@@ -922,18 +928,6 @@ foundNote:
     return false;
 }
 
-unsigned char mem_rd(unsigned address);
-void mem_wr(unsigned address, unsigned char data);
-
-#include "cpu_2a03.hpp"
-
-std::array<unsigned char, 1 << 16> memory;
-std::array<int, 32> apu_registers;
-std::array<int, 32> prev_apu_registers;
-std::array<int, NUM_SFX_CHAN> volume;
-bool log_cpu;
-bool effect_stop;
-
 bool register_allowed(unsigned address)
 {
     switch(address)
@@ -955,12 +949,51 @@ bool register_allowed(unsigned address)
     }
 }
 
-unsigned char mem_rd(unsigned address)
+using apu_register_log_t = std::vector<std::array<int, 32>>;
+
+// Emulates an NSF file, logging the APU registers its effects write.
+// Each emulator has its own memory and registers,
+// letting effects be emulated on several threads at once.
+class nsf_emulator_t
 {
-    return address < 0x2000 ? memory[address & 0x7FF] : memory[address];
-}
+public:
+    nsf_emulator_t(std::uint8_t const* nsf_data, std::size_t nsf_size, nsf_t const& nsf)
+    : nsf_data(nsf_data)
+    , nsf_size(nsf_size)
+    , nsf(nsf)
+    , memory(1 << 16) // (Too big for the stack.)
+    {
+        assert(nsf_data);
+        assert(nsf_size >= 128);
+        assert(nsf.load_addr < memory.size());
+        assert(nsf_size-128 <= memory.size() - nsf.load_addr);
+    }
+
+    // Returns the APU registers at the end of each frame of 'song'.
+    apu_register_log_t run(unsigned song, unsigned mode);
 
-void mem_wr(unsigned address, unsigned char data)
+private:
+    unsigned char mem_rd(unsigned address) const
+    {
+        return address < 0x2000 ? memory[address & 0x7FF] : memory[address];
+    }
+
+    void mem_wr(unsigned address, unsigned char data);
+
+    // The emulator core is included into the class body, making its state per-instance.
+#include "cpu_2a03.hpp"
+
+    std::uint8_t const* nsf_data;
+    std::size_t nsf_size;
+    nsf_t const& nsf;
+
+    std::vector<unsigned char> memory;
+    std::array<int, 32> apu_registers;
+    bool log_cpu;
+    bool effect_stop;
+};
+
+void nsf_emulator_t::mem_wr(unsigned address, unsigned char data)
 {
     // RAM writes:
     if(address < 0x2000)
@@ -985,18 +1018,8 @@ void mem_wr(unsigned address, unsigned char data)
         if(address >= 0x4010 && address <= 0x4013)
             throw std::runtime_error("DMC is not supported.\n");
 
-        if(register_allowed(address) && apu_registers[address-0x4000] != data)
-        {
-            switch(address)
-            {
-            case 0x4000: volume[CHAN_SQUARE1]  = data & 0x0F; break;
-            case 0x4004: volume[CHAN_SQUARE2]  = data & 0x0F; break;
-            case 0x4008: volume[CHAN_TRIANGLE] = data & 0x7F; break;
-            case 0x400C: volume[CHAN_NOISE]    = data & 0x0F; break;
-            }
-
+        if(register_allowed(address))
             apu_registers[address - 0x4000] = data;
-        }
 
         // Catch the C00 effect.
         if(address == 0x4015 && data == 0)
@@ -1004,21 +1027,9 @@ void mem_wr(unsigned address, unsigned char data)
     }
 }
 
-const_ht convert_effect(lpstring_t at,
-                        std::uint8_t const* const nsf_data, std::size_t nsf_size,
-                        nsf_t const& nsf, unsigned song, unsigned mode,
-                        std::deque<nsf_track_t>& nsf_tracks,
-                        defined_group_data_t group_pair, bool omni)
+apu_register_log_t nsf_emulator_t::run(unsigned song, unsigned mode)
 {
-    static TLS std::mutex cpu_mutex;
-    std::lock_guard<std::mutex> lock(cpu_mutex);
-
-    assert(nsf_data);
-    assert(nsf_size >= 128);
-    assert(nsf_size-128 <= memory.size() - nsf.load_addr);
-    assert(nsf.load_addr < memory.size());
-
-    memory.fill(0);
+    std::fill(memory.begin(), memory.end(), 0);
     std::memcpy(&memory[nsf.load_addr], nsf_data+128, nsf_size-128);
 
     apu_registers.fill(-1);
@@ -1027,8 +1038,6 @@ const_ht convert_effect(lpstring_t at,
     apu_registers[0x08] = 0x30;
     apu_registers[0x0C] = 0x30;
 
-    volume.fill(0);
-
     // Init nsf code.
     log_cpu = false;
     effect_stop = false;
@@ -1036,16 +1045,13 @@ const_ht convert_effect(lpstring_t at,
     CPU.A = song;
     CPU.X = mode;
     CPU.PC.hl = nsf.init_addr;
-    log_cpu = false;
     for(unsigned i = 0; i < 2000; ++i) 
         cpu_tick(); // 2000 is enough for FT init
     cpu_reset();
 
-    std::vector<std::array<int, 32>> apu_register_log;
-    std::vector<std::array<int, 4>> volume_log;
+    apu_register_log_t apu_register_log;
 
     log_cpu = true;
-    effect_stop = false;
 
     unsigned iter = 0;
     for(effect_stop = false; !effect_stop; ++iter)
@@ -1061,9 +1067,60 @@ const_ht convert_effect(lpstring_t at,
             cpu_tick();
 
         apu_register_log.push_back(apu_registers);
-        volume_log.push_back(volume);
     }
 
+    return apu_register_log;
+}
+
+// Emulates every effect of the NSF, in parallel.
+// This runs on a parse thread, so it only adds threads that parsing leaves idle.
+std::vector<apu_register_log_t> emulate_effects(std::uint8_t const* const nsf_data, std::size_t nsf_size, 
+                                                nsf_t const& nsf, unsigned mode)
+{
+    std::vector<apu_register_log_t> logs(nsf.songs);
+    if(nsf.songs == 0)
+        return logs;
+
+    // Errors are rethrown in song order, to report the same one each compile.
+    std::vector<std::exception_ptr> errors(nsf.songs);
+
+    unsigned const num_threads = std::clamp<unsigned>(1 + idle_parse_threads(), 1,
+                                                      std::min<unsigned>(compiler_options().num_threads, nsf.songs));
+    std::atomic<unsigned> next_song = 0;
+
+    parallelize(num_threads,
+    [&](std::atomic<bool>& exception_thrown)
+    {
+        nsf_emulator_t emulator(nsf_data, nsf_size, nsf);
+
+        unsigned song;
+        while(!exception_thrown && (song = next_song++) < nsf.songs)
+        {
+            try
+            {
+                logs[song] = emulator.run(song, mode);
+            }
+            catch(...)
+            {
+                // Songs below this one were already taken, and will still finish.
+                errors[song] = std::current_exception();
+                exception_thrown = true;
+            }
+        }
+    },
+    []{});
+
+    for(std::exception_ptr const& error : errors)
+        if(error)
+            std::rethrow_exception(error);
+
+    return logs;
+}
+
+const_ht convert_effect(lpstring_t at, apu_register_log_t const& apu_register_log, unsigned song,
+                        std::deque<nsf_track_t>& nsf_tracks,
+                        defined_group_data_t group_pair, bool omni)
+{
     for(unsigned k = 0; k < NUM_SFX_CHAN; ++k)
     {
         asm_proc_t proc;
@@ -1258,10 +1315,12 @@ void convert_puf_sfx(char const* const txt_data, std::size_t txt_size,
     auto omni_group_pair = group.define_data({}, true);
     assert(data_group_pair.data && omni_group_pair.data);
 
-    std::vector<const_ht> gconsts;
+    std::vector<apu_register_log_t> const logs = emulate_effects(nsf_data, nsf_size, nsf, 0);
 
+    // Define the consts in song order, keeping handles deterministic.
+    std::vector<const_ht> gconsts;
     for(unsigned i = 0; i < nsf.songs; ++i)
-        gconsts.push_back(convert_effect(at, nsf_data, nsf_size, nsf, i, 0, nsf_tracks, data_group_pair, false));
+        gconsts.push_back(convert_effect(at, logs[i], i, nsf_tracks, data_group_pair, false));
 
     {
         // puf_sfx_lo
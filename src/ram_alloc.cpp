@@ -4,6 +4,9 @@
 #include <iostream>
 #endif
 
+#include <cmath>
+#include <limits>
+
 #include "flat/small_set.hpp"
 
 #include "decl.hpp"
@@ -11,6 +14,8 @@
 #include "group.hpp"
 #include "compiler_error.hpp"
 #include "options.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
 #include "ram.hpp"
 #include "rom.hpp"
 #include "debug_print.hpp"
@@ -54,6 +59,55 @@ sram_request_t sram_request(mods_t const* mods)
     return SRAM_MAYBE;
 }
 
+// Calls 'callback(inst, cycles)' for each instruction of 'fn' that would run faster
+// with its argument in ZP, passing the cycles saved per call of 'fn'.
+template<typename Fn>
+static void for_each_zp_saving(fn_t const& fn, Fn const& callback)
+{
+    if(!fn.rom_proc())
+        return;
+
+    asm_proc_t const& proc = fn.rom_proc()->asm_proc();
+    std::vector<float> const freqs = inst_frequencies(proc);
+
+    for(unsigned i = 0; i < proc.code.size(); ++i)
+    {
+        asm_inst_t const& inst = proc.code[i];
+
+        // A hi-byte implies absolute.
+        if(inst.alt && !inst.alt.eq_const(0))
+            continue;
+
+        addr_mode_t const zp_mode = zp_equivalent(op_addr_mode(inst.op));
+        if(zp_mode == MODE_BAD)
+            continue;
+
+        op_t const zp_op = get_op(op_name(inst.op), zp_mode);
+        if(zp_op && op_cycles(inst.op) > op_cycles(zp_op))
+            callback(inst, freqs[i] * float(op_cycles(inst.op) - op_cycles(zp_op)));
+    }
+}
+
+// Finds which fn owns the lvar 'loc', when used inside 'fn'.
+static std::pair<fn_ht, int> find_lvar(fn_ht fn, locator_t loc)
+{
+    if(has_fn(loc.lclass()) && loc.fn())
+        fn = loc.fn();
+    if(!fn)
+        return { fn, -1 };
+    return { fn, fn->lvars().index(loc) };
+}
+
+static std::vector<fn_ht> stable_fns()
+{
+    std::vector<fn_ht> fns;
+    for(fn_ht fn : fn_ht::handles())
+        fns.push_back(fn);
+    std::sort(fns.begin(), fns.end(), [](fn_ht a, fn_ht b)
+        { return global_t::stable_less(a->global, b->global); });
+    return fns;
+}
+
 // Allocates a span inside 'usable_ram'.
 static span_t alloc_ram(ram_sets_t const& usable_ram, std::size_t size, 
                         zp_request_t zp, sram_request_t sram,
@@ -210,6 +264,9 @@ private:
     template<step_t Step>
     void alloc_locals(romv_t romv, fn_ht h);
 
+    // Returns how many bytes of ZP gvars can use, leaving the rest for lvars.
+    int gvar_zp_budget(int zp_free, rh::batman_map<locator_t, float> const& gmember_weight) const;
+
     struct group_vars_d
     {
         // Addresses that can be used to allocate globals.
@@ -240,6 +297,9 @@ private:
         // Like above, but includes called fns too.
         std::array<ram_sets_t, NUM_ROMV> recursive_lvar_ram = {};
 
+        // Estimated cycles per frame saved by putting each lvar in ZP.
+        std::vector<float> lvar_weights;
+
         // Stores indexes into 'romv_allocated'.
         std::array<fc::small_set<unsigned, 2>, NUM_ROMV> romv_self;
         std::array<fc::small_set<unsigned, 2>, NUM_ROMV> romv_interferes;
@@ -265,6 +325,126 @@ private:
     log_t* log = nullptr;
 };
 
+int ram_allocator_t::gvar_zp_budget(int zp_free, rh::batman_map<locator_t, float> const& gmember_weight) const
+{
+    // Without weights, lvars get this many bytes:
+    int const default_local_zp = std::min(32, zp_free - zp_free / 2);
+
+    // Variables are taken by estimated cycles saved per byte, hottest first,
+    // with ZP-only variables before everything else.
+    // The most that fit decide the split.
+
+    constexpr float ZP_ONLY = std::numeric_limits<float>::infinity();
+
+    struct demand_t
+    {
+        float density;
+        unsigned size;
+        fn_ht fn; // Null for gvars.
+    };
+
+    std::vector<demand_t> demands;
+
+    for(gvar_t const& gvar : gvar_ht::values())
+    {
+        gvar.for_each_locator([&](locator_t loc)
+        {
+            loc = loc.mem_head();
+            if(!loc.mem_zp_valid())
+                return;
+            if(loc.mem_zp_only())
+                demands.push_back({ ZP_ONLY, loc.mem_size(), {} });
+            else if(float const* weight = gmember_weight.mapped(loc); weight && *weight > 0.0f)
+                demands.push_back({ *weight / loc.mem_size(), loc.mem_size(), {} });
+        });
+    }
+
+    std::vector<fn_ht> fns;
+
+    for(fn_ht fn : fn_ht::handles())
+    {
+        if(fn->fclass == FN_CT)
+            continue;
+
+        fns.push_back(fn);
+        fn_d const& d = fn_data[fn.id];
+
+        for(unsigned i = 0; i < fn->lvars().num_this_lvars(); ++i)
+        {
+            auto const& info = fn->lvars().this_lvar_info(i);
+            if(!info.zp_valid)
+                continue;
+            if(info.zp_only)
+                demands.push_back({ ZP_ONLY, info.size, fn });
+            else if(d.lvar_weights[i] > 0.0f)
+                demands.push_back({ d.lvar_weights[i] / info.size, info.size, fn });
+        }
+    }
+
+    // Returns the bytes used by gvars and lvars at least as hot as 'threshold'.
+    // Lvars of fns that don't call each other can share bytes,
+    // so lvars are measured along the worst fn and everything it calls.
+    std::vector<unsigned> fn_bytes(fn_ht::pool().size());
+    auto const bytes_at = [&](float threshold) -> std::pair<int, int>
+    {
+        int gvar_bytes = 0;
+        std::fill(fn_bytes.begin(), fn_bytes.end(), 0);
+
+        for(demand_t const& demand : demands)
+        {
+            if(demand.density < threshold)
+                continue;
+            if(demand.fn)
+                fn_bytes[demand.fn.id] += demand.size;
+            else
+                gvar_bytes += demand.size;
+        }
+
+        int lvar_bytes = 0;
+        for(fn_ht fn : fns)
+        {
+            int bytes = fn_bytes[fn.id];
+            fn->ir_calls().for_each([&](fn_ht call) { bytes += fn_bytes[call.id]; });
+            lvar_bytes = std::max(lvar_bytes, bytes);
+        }
+
+        return { gvar_bytes, lvar_bytes };
+    };
+
+    std::vector<float> thresholds;
+    thresholds.reserve(demands.size());
+    for(demand_t const& demand : demands)
+        thresholds.push_back(demand.density);
+    std::sort(thresholds.begin(), thresholds.end(), std::greater<>{});
+    thresholds.erase(std::unique(thresholds.begin(), thresholds.end()), thresholds.end());
+
+    // Binary search for the lowest threshold that fits,
+    // as lowering it only ever adds bytes.
+    std::pair<int, int> fit = { 0, 0 };
+    std::size_t lo = 0;
+    std::size_t hi = thresholds.size();
+    while(lo < hi)
+    {
+        std::size_t const mid = (lo + hi) / 2;
+        auto const bytes = bytes_at(thresholds[mid]);
+        if(bytes.first + bytes.second <= zp_free)
+        {
+            fit = bytes;
+            lo = mid + 1;
+        }
+        else
+            hi = mid;
+    }
+
+    if(lo == 0 && !thresholds.empty())
+        return zp_free - default_local_zp; // Not even the hottest variables fit.
+
+    // Bytes left over go to lvars, up to the default amount, then to gvars.
+    int const leftover = zp_free - fit.first - fit.second;
+    int const local_zp = fit.second + std::min(leftover, std::max(0, default_local_zp - fit.second));
+    return zp_free - local_zp;
+}
+
 ram_allocator_t::ram_allocator_t(log_t* log, ram_bitset_t const& initial_usable_ram)
 : static_usable_ram(initial_usable_ram)
 , log(log)
@@ -277,20 +457,50 @@ ram_allocator_t::ram_allocator_t(log_t* log, ram_bitset_t const& initial_usable_
     // Amount of bytes free in zero page
     int const zp_free = (static_usable_ram.ram & zp_bitset).popcount();
 
-    // Amount of bytes in zp dedicated to locals
-    int const max_local_zp = 32;
-
-    // Amount of bytes in zp dedicated to gvars
-    int const max_gvar_zp = std::max(zp_free - max_local_zp, zp_free / 2);
-
     group_vars_data.resize(group_vars_ht::pool().size());
     fn_data.resize(fn_ht::pool().size());
 
+    // Estimate how many cycles per frame each variable would save if it were in ZP,
+    // giving hot variables priority over cold ones.
+
+    rh::batman_map<locator_t, float> gmember_weight;
+    {
+        trace_span_t const span("alloc", "ram weights");
+        fn_frequencies_t const fn_freqs = estimate_fn_frequencies();
+
+        for(fn_ht fn : fn_ht::handles())
+            fn_data[fn.id].lvar_weights.resize(fn->lvars().num_all_lvars(), 0.0f);
+
+        for(fn_ht fn : stable_fns())
+        {
+            float fn_freq = 0.0f;
+            for(unsigned romv = 0; romv < NUM_ROMV; ++romv)
+                fn_freq += fn_freqs[romv][fn.id];
+
+            if(fn_freq <= 0.0f)
+                continue;
+
+            for_each_zp_saving(*fn, [&](asm_inst_t const& inst, float cycles)
+            {
+                if(inst.arg.lclass() == LOC_GMEMBER)
+                    gmember_weight[inst.arg.mem_head()] += fn_freq * cycles;
+                else if(auto const [lfn, i] = find_lvar(fn, inst.arg); i >= 0)
+                    fn_data[lfn.id].lvar_weights[i] += fn_freq * cycles;
+            });
+        }
+    }
+
+    // Amount of bytes in zp dedicated to gvars
+    int const max_gvar_zp = gvar_zp_budget(zp_free, gmember_weight);
+    dprint(log, "-ALLOC_RAM_GVAR_ZP", max_gvar_zp, zp_free);
+
     ///////////////////
     // ALLOC GLOBALS //
     ///////////////////
 
     {
+        trace_span_t const span("alloc", "ram globals");
+
         // Alloc spans
         for(gmember_t& gm : gmember_ht::values())
             gm.alloc_spans();
@@ -470,6 +680,10 @@ ram_allocator_t::ram_allocator_t(log_t* log, ram_bitset_t const& initial_usable_
 
         for(fn_t const& fn : fn_ht::values())
         {
+            // Unreachable fns are never emitted, so their uses don't count.
+            if(!fn.precheck_romv())
+                continue;
+
             rom_proc_t const* rom_proc = &fn.rom_proc().safe();
 
             for(asm_inst_t const& inst : rom_proc->asm_proc().code)
@@ -531,12 +745,17 @@ ram_allocator_t::ram_allocator_t(log_t* log, ram_bitset_t const& initial_usable_
                 non_zp_vec.push_back({ (pair.first.mem_size() * size_scale) + pair.second, pair.first });
         }
 
-        std::sort(ordered_gmembers_zp.begin(), ordered_gmembers_zp.end(), 
-                  [](auto const& lhs, auto const& rhs) { return lhs.score > rhs.score; });
-        std::sort(ordered_gmembers.begin(), ordered_gmembers.end(), 
-                  [](auto const& lhs, auto const& rhs) { return lhs.score > rhs.score; });
-        std::sort(ordered_gmembers_aligned.begin(), ordered_gmembers_aligned.end(), 
-                  [](auto const& lhs, auto const& rhs) { return lhs.score > rhs.score; });
+        // Ties are broken by locator, to keep the order independent of map iteration order:
+        auto const rank_greater = [](rank_t const& lhs, rank_t const& rhs)
+        {
+            if(lhs.score != rhs.score)
+                return lhs.score > rhs.score;
+            return lhs.loc < rhs.loc;
+        };
+
+        std::sort(ordered_gmembers_zp.begin(), ordered_gmembers_zp.end(), rank_greater);
+        std::sort(ordered_gmembers.begin(), ordered_gmembers.end(), rank_greater);
+        std::sort(ordered_gmembers_aligned.begin(), ordered_gmembers_aligned.end(), rank_greater);
 
         // Estimate which locators will go into ZP.
 
@@ -595,8 +814,24 @@ ram_allocator_t::ram_allocator_t(log_t* log, ram_bitset_t const& initial_usable_
         for(rank_t const& rank : ordered_gmembers_zp)
             estimate_gmember_loc(rank.loc);
 
-        for(rank_t const& rank : ordered_gmembers)
-            estimate_gmember_loc(rank.loc);
+        // Whatever saves the most cycles per byte is estimated first.
+        // Ties, such as variables only used in cold code, keep the allocation order.
+        {
+            std::vector<std::pair<float, locator_t>> by_weight;
+            by_weight.reserve(ordered_gmembers.size());
+
+            for(rank_t const& rank : ordered_gmembers)
+            {
+                float const* weight = gmember_weight.mapped(rank.loc);
+                by_weight.emplace_back(weight ? *weight / rank.loc.mem_size() : 0.0f, rank.loc);
+            }
+
+            std::stable_sort(by_weight.begin(), by_weight.end(), [](auto const& lhs, auto const& rhs)
+                { return lhs.first > rhs.first; });
+
+            for(auto const& pair : by_weight)
+                estimate_gmember_loc(pair.second);
+        }
 
         for(rank_t const& rank : ordered_gmembers_aligned)
             estimate_gmember_loc(rank.loc);
@@ -663,8 +898,12 @@ ram_allocator_t::ram_allocator_t(log_t* log, ram_bitset_t const& initial_usable_
                 ordered_inits.push_back(std::move(value_inits));
         }
 
-        std::sort(ordered_inits.begin(), ordered_inits.end(), 
-                  [](auto const& lhs, auto const& rhs) { return lhs.score > rhs.score; });
+        std::sort(ordered_inits.begin(), ordered_inits.end(), [](auto const& lhs, auto const& rhs) 
+        { 
+            if(lhs.score != rhs.score)
+                return lhs.score > rhs.score; 
+            return lhs.init.front() < rhs.init.front();
+        });
 
         auto const alloc_gmember_loc = [&](locator_t loc)
         {
@@ -795,6 +1034,8 @@ ram_allocator_t::ram_allocator_t(log_t* log, ram_bitset_t const& initial_usable_
     //////////////////
 
     {
+        trace_span_t const span("alloc", "ram locals");
+
         // Use group_vars usable_ram to build fn usable_ram.
         for(fn_ht fn : fn_ht::handles())
         {
@@ -873,7 +1114,9 @@ void ram_allocator_t::build_order(romv_t romv, std::vector<fn_ht>& fn_order, std
 {
     std::sort(input_fns.begin(), input_fns.end(), [&](fn_ht a, fn_ht b)
     {
-        return data(a).lvar_count > data(b).lvar_count;
+        if(data(a).lvar_count != data(b).lvar_count)
+            return data(a).lvar_count > data(b).lvar_count;
+        return global_t::stable_less(a->global, b->global);
     });
 
     for(fn_ht input_fn : input_fns)
@@ -986,6 +1229,7 @@ void ram_allocator_t::alloc_locals(romv_t const romv, fn_ht h)
 
     struct rank_t
     {
+        int coldness;
         float score;
         unsigned lvar_i;
         constexpr auto operator<=>(rank_t const&) const = default;
@@ -1020,7 +1264,14 @@ void ram_allocator_t::alloc_locals(romv_t const romv, fn_ht h)
         int const interferences = bitset_popcount(fn.lvars().bitset_size(), fn.lvars().lvar_interferences(i));
         float const score = float(usable - int(info.size)) / interferences;
 
-        ordered_lvars.push_back({ score, i });
+        // Hotter lvars go first, getting first pick of ZP.
+        // Coldness is measured in powers of LOOP_ITERATIONS, so that only sizable differences matter.
+        float const weight = d.lvar_weights[i] / info.size;
+        int const coldness = weight > 0.0f 
+            ? -int(std::floor(std::log(weight) / std::log(LOOP_ITERATIONS))) 
+            : std::numeric_limits<int>::max();
+
+        ordered_lvars.push_back({ coldness, score, i });
     }
 
     std::sort(ordered_lvars.begin(), ordered_lvars.end());
@@ -1175,8 +1426,56 @@ void alloc_ram(log_t* log, ram_bitset_t const& initial)
     ram_allocator_t a(log, initial);
 }
 
+// Estimates the fraction of executed cycles saved by the variables allocated in ZP.
+// (Absolute counts aren't reported, as the loop iteration guesses make them unreliable.)
+static float zp_cycles_saved()
+{
+    fn_frequencies_t const fn_freqs = estimate_fn_frequencies();
+    float saved = 0.0f;
+    float total = 0.0f;
+
+    for(fn_ht fn : stable_fns())
+    {
+        if(!fn->rom_proc())
+            continue;
+
+        float fn_freq = 0.0f;
+        for(unsigned romv = 0; romv < NUM_ROMV; ++romv)
+            fn_freq += fn_freqs[romv][fn.id];
+
+        asm_proc_t const& proc = fn->rom_proc()->asm_proc();
+        std::vector<float> const freqs = inst_frequencies(proc);
+        for(unsigned i = 0; i < proc.code.size(); ++i)
+            total += fn_freq * freqs[i] * op_cycles(proc.code[i].op);
+
+        for_each_zp_saving(*fn, [&](asm_inst_t const& inst, float cycles)
+        {
+            for(unsigned romv = 0; romv < NUM_ROMV; ++romv)
+            {
+                float const freq = fn_freqs[romv][fn.id];
+                if(freq <= 0.0f)
+                    continue;
+
+                span_t span = {};
+                if(inst.arg.lclass() == LOC_GMEMBER)
+                    span = inst.arg.gmember()->span(inst.arg.atom());
+                else if(auto const [lfn, i] = find_lvar(fn, inst.arg); i >= 0)
+                    span = lfn->lvar_span(romv_t(romv), i);
+
+                if(span && span.addr + inst.arg.offset() < 0x100)
+                    saved += freq * cycles;
+            }
+        });
+    }
+
+    // 'total' counts ZP instructions at their absolute cost:
+    return total > 0.0f ? saved / total : 0.0f;
+}
+
 void print_ram(std::ostream& o)
 {
+    o << fmt("Estimated cycles saved by zero page: %%\n\n", std::round(zp_cycles_saved() * 1000.0f) / 10.0f);
+
     o << "Global variable RAM:\n\n";
 
     o << fmt("  /:\n");
@@ -1,5 +1,6 @@
 #include "rom_alloc.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <vector>
 #ifndef NDEBUG
@@ -15,6 +16,11 @@
 #include "span_allocator.hpp"
 #include "debug_print.hpp"
 #include "lt.hpp"
+#include "profile.hpp"
+#include "trace.hpp"
+
+// Set by '--bank-affinity', for 'print_rom':
+static float predicted_bank_switches = 0.0f;
 
 class rom_allocator_t
 {
@@ -30,6 +36,15 @@ private:
         constexpr auto operator<=>(bank_rank_t const& o) const = default;
     };
 
+    // A call site that uses a bank switch, weighted by its expected calls per frame.
+    struct banked_call_t
+    {
+        rom_alloc_ht caller;
+        rom_alloc_ht callee;
+        float weight;
+        bool removable; // If the bank switch goes away when both are in the same bank.
+    };
+
     /////////////
     // MEMBERS //
     /////////////
@@ -44,6 +59,10 @@ private:
     unsigned many_bs_size = 0;
     unsigned once_bs_size = 0;
 
+    // Used by '--bank-affinity':
+    std::vector<banked_call_t> banked_calls;
+    std::vector<std::vector<std::pair<rom_alloc_ht, float>>> once_affinity;
+
     span_t switched_span = {};
     unsigned const num_switched_banks = mapper().num_switched_prg_banks();
 
@@ -57,10 +76,19 @@ private:
     float once_rank(rom_once_t const& once);
 
     // Used to find the best bank to allocate a once in
-    float bank_rank(rom_bank_t const& bank, rom_once_t const& once);
+    float bank_rank(rom_bank_t const& bank, unsigned bank_i, rom_once_ht once_h);
+
+    // Builds 'banked_calls' and 'once_affinity' from the procs' call sites.
+    void build_affinity(std::vector<rom_proc_ht> const& stable_rom_procs);
+
+    // Estimates how many bank switches will occur each frame.
+    float predicted_switches() const;
+
+    // Empties every bank, undoing the allocation of ONCEs and MANYs.
+    void reset_banks(span_allocator_t const& allocator);
 
     // Builds 'bank_ranks'.
-    void rank_banks_for(rom_once_t const& once);
+    void rank_banks_for(rom_once_ht once_h);
 
     // Allocates a 'once', while also allocating the 'many's it uses.
     void alloc(rom_once_ht once_h);
@@ -81,6 +109,72 @@ private:
     span_t alloc_dpcm(unsigned size);
 };
 
+// Rom data gets created by multiple compiler threads, so handle order isn't reproducible.
+// These comparisons order by content instead, making ONCE and MANY numbering stable.
+
+static global_t const* stable_global(locator_t loc)
+{
+    locator_class_t const lclass = loc.lclass();
+
+    if(has_fn(lclass))
+        return &loc.fn()->global;
+    if(has_const(lclass))
+        return &loc.const_()->global;
+    if(has_fn_set(lclass))
+        return &loc.fn_set()->global;
+    if(has_global(lclass))
+        return &*loc.global();
+    return nullptr;
+}
+
+static bool stable_less(rom_array_ht a, rom_array_ht b);
+
+static bool stable_less(locator_t a, locator_t b)
+{
+    if(a.lclass() != b.lclass())
+        return a.lclass() < b.lclass();
+
+    if(a.lclass() == LOC_ROM_ARRAY && a.rom_array() != b.rom_array())
+        return stable_less(a.rom_array(), b.rom_array());
+
+    global_t const* const a_global = stable_global(a);
+    global_t const* const b_global = stable_global(b);
+    if(a_global && b_global && a_global != b_global)
+        return global_t::stable_less(*a_global, *b_global);
+
+    return a.to_uint() < b.to_uint();
+}
+
+static bool stable_less(rom_array_ht a, rom_array_ht b)
+{
+    loc_vec_t const& a_data = a->data();
+    loc_vec_t const& b_data = b->data();
+
+    if(a_data.size() != b_data.size())
+        return a_data.size() < b_data.size();
+
+    auto const mismatch = std::mismatch(a_data.begin(), a_data.end(), b_data.begin());
+    if(mismatch.first != a_data.end())
+        return stable_less(*mismatch.first, *mismatch.second);
+
+    return a.id < b.id;
+}
+
+static bool stable_less(rom_proc_ht a, rom_proc_ht b)
+{
+    fn_ht const a_fn = a->asm_proc().fn;
+    fn_ht const b_fn = b->asm_proc().fn;
+
+    // Procs without a fn are created single-threaded, so their order is already stable.
+    if(!a_fn || !b_fn)
+        return a_fn ? false : (b_fn ? true : a.id < b.id);
+
+    if(a_fn != b_fn)
+        return global_t::stable_less(a_fn->global, b_fn->global);
+
+    return a.id < b.id;
+}
+
 rom_allocator_t::rom_allocator_t(log_t* log, span_allocator_t& allocator)
 : switched_span(mapper().switched_rom_span())
 , log(log)
@@ -146,7 +240,15 @@ rom_allocator_t::rom_allocator_t(log_t* log, span_allocator_t& allocator)
     // Convert 'rom_array's //
     //////////////////////////
 
-    for(rom_array_ht rom_array_h : rom_array_ht::handles())
+    auto const rom_array_handles = rom_array_ht::handles();
+    std::vector<rom_array_ht> stable_rom_arrays(rom_array_handles.begin(), rom_array_handles.end());
+    std::sort(stable_rom_arrays.begin(), stable_rom_arrays.end(), [](rom_array_ht a, rom_array_ht b) { return stable_less(a, b); });
+
+    auto const rom_proc_handles = rom_proc_ht::handles();
+    std::vector<rom_proc_ht> stable_rom_procs(rom_proc_handles.begin(), rom_proc_handles.end());
+    std::sort(stable_rom_procs.begin(), stable_rom_procs.end(), [](rom_proc_ht a, rom_proc_ht b) { return stable_less(a, b); });
+
+    for(rom_array_ht rom_array_h : stable_rom_arrays)
     {
         dprint(log, "-PREP_ALLOC_ROM_ARRAY", rom_array_h);
         rom_array_t& rom_array = *rom_array_h;
@@ -238,7 +340,7 @@ rom_allocator_t::rom_allocator_t(log_t* log, span_allocator_t& allocator)
         });
     }
 
-    for(rom_proc_ht rom_proc_h : rom_proc_ht::handles())
+    for(rom_proc_ht rom_proc_h : stable_rom_procs)
     {
         dprint(log, "-PREP_ALLOC_ROM_PROC", rom_proc_h);
         rom_proc_t& rom_proc = *rom_proc_h;
@@ -455,14 +557,13 @@ rom_allocator_t::rom_allocator_t(log_t* log, span_allocator_t& allocator)
     // Init banks //
     ////////////////
 
-    // Copy 'allocator' to fill banks.
-    banks.clear();
-    for(unsigned i = 0; i < num_switched_banks; ++i)
-        banks.emplace_back(mapper().fixed_16k ? span_allocator_t(switched_span) : allocator, 
-                           many_bs_size, once_bs_size);
+    reset_banks(allocator);
 
     bank_ranks.resize(num_switched_banks);
 
+    if(compiler_options().bank_affinity && mapper().bankswitches())
+        build_affinity(stable_rom_procs);
+
     struct once_rank_t
     {
         float score;
@@ -483,8 +584,54 @@ rom_allocator_t::rom_allocator_t(log_t* log, span_allocator_t& allocator)
     std::sort(ordered_onces.begin(), ordered_onces.end(), std::greater<>{});
 
     // Allocate onces (this also allocates their required_manys)
-    for(once_rank_t const& rank : ordered_onces)
-        alloc(rank.once);
+    auto const alloc_onces = [&]
+    {
+        for(once_rank_t const& rank : ordered_onces)
+            alloc(rank.once);
+    };
+
+    if(once_affinity.empty())
+        alloc_onces();
+    else
+    {
+        try
+        {
+            alloc_onces();
+        }
+        catch(std::runtime_error const&)
+        {
+            // Affinity can pack banks worse than the default ranking.
+            // If the ROM doesn't fit, start over without it.
+            dprint(log, "-BANK AFFINITY DIDN'T FIT");
+            once_affinity.clear();
+            reset_banks(allocator);
+            alloc_onces();
+        }
+    }
+
+    if(compiler_options().bank_affinity)
+        predicted_bank_switches = predicted_switches();
+}
+
+void rom_allocator_t::reset_banks(span_allocator_t const& allocator)
+{
+    // Copy 'allocator' to fill banks.
+    banks.clear();
+    for(unsigned i = 0; i < num_switched_banks; ++i)
+        banks.emplace_back(mapper().fixed_16k ? span_allocator_t(switched_span) : allocator, 
+                           many_bs_size, once_bs_size);
+
+    for(rom_once_t& once : rom_once_ht::values())
+    {
+        once.span = {};
+        once.bank = ~0;
+    }
+
+    for(rom_many_t& many : rom_many_ht::values())
+    {
+        many.span = {};
+        many.in_banks = {};
+    }
 }
 
 float rom_allocator_t::once_rank(rom_once_t const& once)
@@ -503,8 +650,10 @@ float rom_allocator_t::once_rank(rom_once_t const& once)
     return many_size + once.max_size() * 4 + related * 2;
 }
 
-float rom_allocator_t::bank_rank(rom_bank_t const& bank, rom_once_t const& once)
+float rom_allocator_t::bank_rank(rom_bank_t const& bank, unsigned bank_i, rom_once_ht once_h)
 {
+    rom_once_t const& once = *once_h;
+
     // Count how much we have to allocate for required_manys
     bitset_uint_t* const unallocated_manys = ALLOCA_T(bitset_uint_t, many_bs_size);
     bitset_copy(many_bs_size, unallocated_manys, once.required_manys);
@@ -530,16 +679,35 @@ float rom_allocator_t::bank_rank(rom_bank_t const& bank, rom_once_t const& once)
         unrelated = bitset_popcount(once_bs_size, onces);
     }
 
+    // Count the bank switches saved by joining the procs we call, or are called by.
+    // Each switch per frame is valued like this many bytes of ROM:
+    constexpr float AFFINITY_BYTES = 64.0f;
+
+    float affinity = 0.0f;
+    if(!once_affinity.empty())
+    {
+        for(auto const& pair : once_affinity[once_h.id])
+        {
+            rom_alloc_ht const other = pair.first;
+            if(other.rclass() == ROMA_ONCE ? rom_once_ht{ other.handle() }->bank == bank_i
+                                           : rom_many_ht{ other.handle() }->in_banks.test(bank_i))
+            {
+                affinity += pair.second;
+            }
+        }
+    }
+
     float const r = bank.allocator.initial_bytes_free() * std::sqrt((float)bank.allocator.spans_free());
-    return -unallocated_many_size + related - (unrelated * 0.125f) + (bank.allocator.bytes_free() / r);
+    return -unallocated_many_size + related - (unrelated * 0.125f) + (bank.allocator.bytes_free() / r)
+           + (affinity * AFFINITY_BYTES);
 }
 
-void rom_allocator_t::rank_banks_for(rom_once_t const& once)
+void rom_allocator_t::rank_banks_for(rom_once_ht once_h)
 {
     assert(bank_ranks.size() == banks.size());
 
     for(unsigned i = 0; i < banks.size(); ++i)
-        bank_ranks[i] = { bank_rank(banks[i], once), i };
+        bank_ranks[i] = { bank_rank(banks[i], i, once_h), i };
 
     std::sort(bank_ranks.begin(), bank_ranks.end(), std::greater<>{});
 }
@@ -549,7 +717,7 @@ void rom_allocator_t::alloc(rom_once_ht once_h)
     rom_once_t& once = *once_h;
     bc::small_vector<rom_many_ht, 32> realloced_manys;
 
-    rank_banks_for(once); // Builds 'bank_ranks'
+    rank_banks_for(once_h); // Builds 'bank_ranks'
 
     for(bank_rank_t const& r : bank_ranks)
     {
@@ -627,6 +795,90 @@ void rom_allocator_t::alloc(rom_once_ht once_h)
     throw std::runtime_error(fmt("Unable to allocate address of size % (out of ROM space).", once.max_size()));
 }
 
+void rom_allocator_t::build_affinity(std::vector<rom_proc_ht> const& stable_rom_procs)
+{
+    fn_frequencies_t const fn_freqs = estimate_fn_frequencies();
+
+    for(unsigned romv = 0; romv < NUM_ROMV; ++romv)
+    {
+        for(rom_proc_ht caller_h : stable_rom_procs)
+        {
+            rom_proc_t const& caller = *caller_h;
+            if(!caller.emits() || !caller.get_alloc(romv_t(romv)))
+                continue;
+
+            asm_proc_t const& proc = caller.asm_proc(romv_t(romv));
+            if(!proc.fn)
+                continue;
+
+            float const caller_freq = fn_freqs[romv][proc.fn.id];
+            if(caller_freq <= 0.0f)
+                continue;
+
+            std::vector<float> const freqs = inst_frequencies(proc);
+
+            for(unsigned i = 0; i < proc.code.size(); ++i)
+            {
+                asm_inst_t const& inst = proc.code[i];
+
+                if(inst.arg.lclass() != LOC_FN || inst.alt)
+                    continue;
+
+                op_t const unbanked = unbanked_call_op(inst.op);
+                if(unbanked == BAD_OP)
+                    continue;
+
+                fn_ht const call = inst.arg.fn();
+                if(!call || !call->rom_proc())
+                    continue;
+
+                rom_alloc_ht const callee_alloc = call->rom_proc()->find_alloc(romv_t(romv));
+                if(!callee_alloc)
+                    continue;
+
+                banked_calls.push_back({
+                    .caller = caller.get_alloc(romv_t(romv)),
+                    .callee = callee_alloc,
+                    .weight = caller_freq * freqs[i],
+                    .removable = unbanked == JSR_ABSOLUTE 
+                                 && !call->bank_switches() && !call->returns_in_different_bank() });
+            }
+        }
+    }
+
+    // Convert the calls into affinities of onces.
+    // (MANYs go wherever their onces need them, so they get no affinities of their own.)
+
+    once_affinity.resize(rom_once_ht::pool().size());
+
+    for(banked_call_t const& call : banked_calls)
+    {
+        if(!call.removable || call.caller == call.callee)
+            continue;
+
+        for(auto const& pair : { std::make_pair(call.caller, call.callee), std::make_pair(call.callee, call.caller) })
+            if(pair.first.rclass() == ROMA_ONCE && pair.second.rclass() != ROMA_STATIC)
+                once_affinity[pair.first.handle()].emplace_back(pair.second, call.weight);
+    }
+}
+
+float rom_allocator_t::predicted_switches() const
+{
+    float switches = 0.0f;
+
+    for(banked_call_t const& call : banked_calls)
+    {
+        // Mirrors 'asm_proc_t::remove_banked_jsr':
+        int const bank = call.caller.only_bank();
+        if(call.removable && bank >= 0 && call.callee.bank_bitset().test(bank))
+            continue;
+
+        switches += call.weight;
+    }
+
+    return switches;
+}
+
 bool rom_allocator_t::try_include_many(rom_many_ht many_h, unsigned bank_i)
 {
     rom_many_t& many = *many_h;
@@ -762,6 +1014,7 @@ bool rom_allocator_t::realloc_many(rom_many_ht many_h, bank_bitset_t in_banks)
     
 void alloc_rom(log_t* log, span_allocator_t allocator)
 {
+    trace_span_t const span("alloc", "rom");
     rom_allocator_t alloc(log, allocator);
 }
 
@@ -771,6 +1024,9 @@ void print_rom(std::ostream& o)
 
     o << "ROM:\n\n";
 
+    if(compiler_options().bank_affinity)
+        o << "PREDICTED BANK SWITCHES PER FRAME: " << predicted_bank_switches << "\n\n";
+
     for(auto const& st : rom_static_ht::values())
     {
         o << "STATIC " << st.span << '\n';
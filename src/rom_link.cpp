@@ -14,10 +14,13 @@
 #include "globals.hpp"
 #include "compiler_error.hpp"
 #include "eval.hpp"
+#include "trace.hpp"
 
 // This gets called before ROM is allocated.
 void link_variables_optimize()
 {
+    trace_span_t const span("alloc", "link variables");
+
     for(rom_proc_t& rom_proc : rom_proc_ht::values())
     {
         romv_for_each(rom_proc.desired_romv(), [&](romv_t romv)
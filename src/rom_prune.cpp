@@ -9,6 +9,7 @@
 #include "lt.hpp"
 #include "globals.hpp"
 #include "group.hpp"
+#include "trace.hpp"
 
 static void rom_mark_emits(rom_data_ht data);
 
@@ -24,6 +25,10 @@ static void locator_mark_emits(locator_t loc)
             rom_mark_emits(fn->rom_proc());
     }
 
+    if(loc.lclass() == LOC_RUNTIME_ROM && runtime_rom_on_demand(loc.runtime_rom()))
+        if(rom_data_ht h = runtime_data(loc.runtime_rom()))
+            rom_mark_emits(h);
+
     if(loc.lclass() == LOC_LT_EXPR)
     {
         lt_value_t& value = *loc.lt();
@@ -49,8 +54,12 @@ static void rom_mark_emits(rom_data_ht data)
 
 void prune_rom_data()
 {
+    trace_span_t const span("alloc", "prune rom");
+
     // Recursively mark rom_data as being emitted, starting from the runtime rom.
+    // (On-demand runtime rom is only marked when something refers to it.)
     for(runtime_rom_name_t rtrom = {}; rtrom < NUM_RTROM; rtrom = runtime_rom_name_t(rtrom + 1))
-        if(rom_data_ht data = runtime_data(rtrom))
-            rom_mark_emits(data);
+        if(!runtime_rom_on_demand(rtrom))
+            if(rom_data_ht data = runtime_data(rtrom))
+                rom_mark_emits(data);
 }
@@ -59,6 +59,9 @@ RT(jsr_trampoline) \
 RT(jmp_indirect) \
 RT(iota) \
 RT(mul8) \
+RT(mul8_table) \
+RT(square_lo_table) \
+RT(square_hi_table) \
 RT(mapper_reset) \
 RT(shl4_table) \
 RT(shl5_table) \
@@ -86,6 +89,13 @@ inline runtime_rom_name_t shl_table(int amount)
     }
 }
 
+// Runtime ROM that's only emitted when code refers to it.
+// Rather than being allocated up front, it's allocated alongside the program's code.
+constexpr bool runtime_rom_on_demand(runtime_rom_name_t name)
+{
+    return name == RTROM_mul8_table || name == RTROM_square_lo_table || name == RTROM_square_hi_table;
+}
+
 ram_bitset_t alloc_runtime_ram();
 span_allocator_t alloc_runtime_rom();
 
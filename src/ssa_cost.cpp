@@ -0,0 +1,319 @@
+#include "ssa_cost.hpp"
+
+#include <algorithm>
+#include <array>
+
+#include "ir.hpp"
+#include "locator.hpp"
+
+namespace // anonymous
+{
+
+template<typename... Ops>
+constexpr ssa_cost_t seq(Ops... ops) { return (ssa_cost_t{} + ... + op_cost(ops)); }
+
+// Code that runs 'n' times, but only takes up space once.
+constexpr ssa_cost_t loop(ssa_cost_t body, unsigned n) { return { body.cycles * n, body.bytes }; }
+
+// Approximate cycles spent inside the runtime's 'mul8' routine, excluding the call.
+constexpr unsigned MUL8_CYCLES = 100;
+
+// The same, for the runtime's 'mul8_table' routine.
+constexpr unsigned MUL8_TABLE_CYCLES = 75;
+
+// Assumed iteration count of variable-length shift loops.
+constexpr unsigned SHIFT_LOOP_ITERATIONS = 4;
+
+struct ssa_cost_def_t
+{
+    ssa_cost_t fixed; // Paid once.
+    ssa_cost_t first; // Paid for the first byte.
+    ssa_cost_t rest;  // Paid for every byte after the first.
+    bool operand = false; // If each byte reads an operand, which can be immediate.
+};
+
+constexpr ssa_cost_def_t ssa_cost_def(ssa_op_t op)
+{
+    switch(op)
+    {
+    default:
+        return {};
+
+    case SSA_if:
+        return { seq(BNE_RELATIVE) };
+    case SSA_jump:
+        return { seq(JMP_ABSOLUTE) };
+    case SSA_switch_full:
+    case SSA_switch_partial:
+    case SSA_switch_table:
+        // (Matches 'ASM_X_SWITCH', not counting the tables.)
+        return { seq(TAX_IMPLIED, LDA_ABSOLUTE_X, PHA_IMPLIED, LDA_ABSOLUTE_X, PHA_IMPLIED, RTS_IMPLIED) };
+    case SSA_return:
+        return { seq(RTS_IMPLIED) };
+    case SSA_fn_call:
+    case SSA_wait_nmi:
+        return { seq(JSR_ABSOLUTE) };
+    case SSA_fn_ptr_call:
+        return { seq(JSR_ABSOLUTE, JMP_INDIRECT) };
+    case SSA_goto_mode:
+        return { seq(JMP_ABSOLUTE) };
+    case SSA_cli:
+        return { seq(CLI_IMPLIED) };
+
+    case SSA_add:
+        return { seq(CLC_IMPLIED), seq(ADC_ABSOLUTE), seq(STA_ABSOLUTE, LDA_ABSOLUTE, ADC_ABSOLUTE), true };
+    case SSA_sub:
+        return { seq(SEC_IMPLIED), seq(SBC_ABSOLUTE), seq(STA_ABSOLUTE, LDA_ABSOLUTE, SBC_ABSOLUTE), true };
+    case SSA_and:
+        return { {}, seq(AND_ABSOLUTE), seq(STA_ABSOLUTE, LDA_ABSOLUTE, AND_ABSOLUTE), true };
+    case SSA_or:
+        return { {}, seq(ORA_ABSOLUTE), seq(STA_ABSOLUTE, LDA_ABSOLUTE, ORA_ABSOLUTE), true };
+    case SSA_xor:
+        return { {}, seq(EOR_ABSOLUTE), seq(STA_ABSOLUTE, LDA_ABSOLUTE, EOR_ABSOLUTE), true };
+
+    case SSA_eq:
+    case SSA_not_eq:
+    case SSA_multi_eq:
+    case SSA_multi_not_eq:
+    case SSA_branch_eq:
+    case SSA_branch_not_eq:
+        return { {}, seq(CMP_ABSOLUTE), seq(BNE_RELATIVE, LDA_ABSOLUTE, CMP_ABSOLUTE), true };
+    case SSA_lt:
+    case SSA_lte:
+    case SSA_multi_lt:
+    case SSA_multi_lte:
+    case SSA_branch_lt:
+    case SSA_branch_lte:
+        return { {}, seq(CMP_ABSOLUTE), seq(LDA_ABSOLUTE, SBC_ABSOLUTE), true };
+    case SSA_sign:
+    case SSA_not_sign:
+    case SSA_branch_sign:
+    case SSA_branch_not_sign:
+        return { {}, seq(ASL_IMPLIED) };
+    case SSA_sign_extend:
+        return { {}, seq(ASL_IMPLIED, LDA_IMMEDIATE, ADC_IMMEDIATE, EOR_IMMEDIATE), seq(STA_ABSOLUTE) };
+
+    case SSA_rol:
+        return { {}, seq(ROL_IMPLIED), seq(ROL_ABSOLUTE) };
+    case SSA_ror:
+        return { {}, seq(ROR_IMPLIED), seq(ROR_ABSOLUTE) };
+    case SSA_shl_table:
+        return { {}, seq(TAX_IMPLIED, LDA_ABSOLUTE_X) };
+    case SSA_mul8_lo:
+        return { seq(LDY_ABSOLUTE, JSR_ABSOLUTE) + ssa_cost_t{ MUL8_CYCLES, 0 } };
+
+    case SSA_read_array8:
+    case SSA_cg_read_array8_direct:
+        return { seq(LDX_ABSOLUTE), seq(LDA_ABSOLUTE_X), seq(STA_ABSOLUTE, LDA_ABSOLUTE_X) };
+    case SSA_write_array8:
+        return { seq(LDX_ABSOLUTE), seq(STA_ABSOLUTE_X), seq(LDA_ABSOLUTE, STA_ABSOLUTE_X) };
+    case SSA_read_array16:
+    case SSA_read_array16_b:
+        return { seq(CLC_IMPLIED, LDA_ABSOLUTE, ADC_IMMEDIATE, STA_ABSOLUTE, LDA_ABSOLUTE, ADC_IMMEDIATE, STA_ABSOLUTE, LDY_IMMEDIATE),
+                 seq(LDA_INDIRECT_Y), seq(STA_ABSOLUTE, INY_IMPLIED, LDA_INDIRECT_Y) };
+    case SSA_write_array16:
+    case SSA_write_array16_b:
+        return { seq(CLC_IMPLIED, LDA_ABSOLUTE, ADC_IMMEDIATE, STA_ABSOLUTE, LDA_ABSOLUTE, ADC_IMMEDIATE, STA_ABSOLUTE, LDY_IMMEDIATE),
+                 seq(STA_INDIRECT_Y), seq(INY_IMPLIED, LDA_ABSOLUTE, STA_INDIRECT_Y) };
+
+    case SSA_read_ptr:
+    case SSA_read_ptr_hw:
+        return { seq(LDY_ABSOLUTE), seq(LDA_INDIRECT_Y), seq(STA_ABSOLUTE, INY_IMPLIED, LDA_INDIRECT_Y) };
+    case SSA_write_ptr:
+    case SSA_write_ptr_hw:
+        return { seq(LDY_ABSOLUTE), seq(STA_INDIRECT_Y), seq(INY_IMPLIED, LDA_ABSOLUTE, STA_INDIRECT_Y) };
+    case SSA_bank_switch:
+        return { seq(LDA_ABSOLUTE, STA_ABSOLUTE) };
+
+    case SSA_nmi_counter:
+    case SSA_ready:
+    case SSA_system:
+    case SSA_read_mapper_state:
+    case SSA_read_ptr_hw_pair:
+        return { {}, seq(LDA_ABSOLUTE), seq(STA_ABSOLUTE, LDA_ABSOLUTE) };
+    case SSA_write_mapper_state:
+    case SSA_write_ptr_hw_pair:
+    case SSA_make_ptr_lo:
+    case SSA_make_ptr_hi:
+    case SSA_phi_copy:
+    case SSA_early_store:
+    case SSA_aliased_store:
+    case SSA_const_store:
+        return { {}, seq(STA_ABSOLUTE), seq(LDA_ABSOLUTE, STA_ABSOLUTE) };
+    }
+}
+
+constexpr auto ssa_cost_table = []
+{
+    std::array<ssa_cost_def_t, NUM_SSA_OPS> table = {};
+    for(unsigned i = 0; i < NUM_SSA_OPS; ++i)
+        table[i] = ssa_cost_def(ssa_op_t(i));
+    return table;
+}();
+
+// Reading an operand as an immediate instead of from memory saves this much, per byte:
+constexpr ssa_cost_t immediate_savings = { op_cycles(LDA_ABSOLUTE) - op_cycles(LDA_IMMEDIATE),
+                                           op_size(LDA_ABSOLUTE) - op_size(LDA_IMMEDIATE) };
+
+ssa_cost_t variable_shift_cost(unsigned width)
+{
+    return seq(LDX_ABSOLUTE, BEQ_RELATIVE)
+           + loop(estimate_shift_cost(width, 1) + seq(DEX_IMPLIED, BNE_RELATIVE), SHIFT_LOOP_ITERATIONS);
+}
+
+ssa_cost_t mul_cost(unsigned width)
+{
+    // Each pair of bytes is multiplied, then the partial products are summed:
+    unsigned const products = width * width;
+    return estimate_mul8_cost(false) * products + estimate_ssa_cost(SSA_add, width) * (products - 1);
+}
+
+} // end anonymous namespace
+
+ssa_cost_t estimate_ssa_cost(ssa_op_t op, unsigned width, bool const_operand)
+{
+    switch(op)
+    {
+    case SSA_shl:
+    case SSA_shr:
+        return variable_shift_cost(width);
+    case SSA_mul:
+        return mul_cost(width);
+    case SSA_fill_array:
+        return seq(LDA_ABSOLUTE, LDX_IMMEDIATE) + loop(seq(STA_ABSOLUTE_X, DEX_IMPLIED, BNE_RELATIVE), width);
+    case SSA_init_array:
+        // Copied from a table in ROM:
+        return seq(LDX_IMMEDIATE) + loop(seq(LDA_ABSOLUTE_X, STA_ABSOLUTE_X, DEX_IMPLIED, BNE_RELATIVE), width)
+               + ssa_cost_t{ 0, width };
+    default:
+        break;
+    }
+
+    ssa_cost_def_t const& def = ssa_cost_table[op];
+    ssa_cost_t cost = def.fixed;
+
+    if(width)
+    {
+        cost += def.first + def.rest * (width - 1);
+
+        if(def.operand && const_operand)
+        {
+            cost.cycles -= immediate_savings.cycles * width;
+            cost.bytes -= immediate_savings.bytes * width;
+        }
+    }
+
+    return cost;
+}
+
+ssa_cost_t estimate_mul8_cost(bool mul_table)
+{
+    ssa_cost_t cost = estimate_ssa_cost(SSA_mul8_lo, 1);
+    if(mul_table)
+        cost.cycles -= MUL8_CYCLES - MUL8_TABLE_CYCLES;
+    return cost;
+}
+
+ssa_cost_t estimate_shift_cost(unsigned width, unsigned amount)
+{
+    ssa_cost_t cost = {};
+
+    // Whole bytes are moved rather than shifted:
+    unsigned const byte_shift = std::min(amount / 8, width);
+    if(byte_shift)
+        cost += seq(LDA_ABSOLUTE, STA_ABSOLUTE) * width;
+
+    width -= byte_shift;
+    if(width)
+        cost += (op_cost(ASL_IMPLIED) + op_cost(ROL_ABSOLUTE) * (width - 1)) * (amount % 8);
+
+    return cost;
+}
+
+ssa_cost_t estimate_ssa_cost(ssa_node_t const& ssa_node)
+{
+    ssa_op_t const op = ssa_node.op();
+    unsigned const input_size = ssa_node.input_size();
+
+    auto const input_width = [&](unsigned i) -> unsigned
+    {
+        return i < input_size ? ssa_node.input(i).type().size_of() : 0;
+    };
+
+    // Calls also have to pass their arguments.
+    // (Other globals the call reads are already in memory.)
+    auto const call_cost = [&]
+    {
+        unsigned arg_bytes = 0;
+        for(unsigned i = write_globals_begin(op); i + 1 < input_size; i += 2)
+        {
+            ssa_value_t const loc = ssa_node.input(i + 1);
+            if(loc.is_locator() && loc.locator().lclass() == LOC_ARG)
+                arg_bytes += input_width(i);
+        }
+        return estimate_ssa_cost(op, 0) + seq(LDA_ABSOLUTE, STA_ABSOLUTE) * arg_bytes;
+    };
+
+    switch(op)
+    {
+    case SSA_shl:
+    case SSA_shr:
+        if(ssa_node.input(1).is_num())
+            return estimate_shift_cost(ssa_node.type().size_of(), ssa_node.input(1).whole());
+        return variable_shift_cost(ssa_node.type().size_of());
+
+    case SSA_fn_call:
+    case SSA_fn_ptr_call:
+    case SSA_goto_mode:
+        return call_cost();
+
+    // Jump tables hold two bytes per case:
+    case SSA_switch_full:
+        return estimate_ssa_cost(op, 1) + ssa_cost_t{ 0, 2 * ssa_node.cfg_node()->output_size() };
+
+    // These take their bytes as separate inputs:
+    case SSA_multi_eq:
+    case SSA_multi_not_eq:
+    case SSA_branch_eq:
+    case SSA_branch_not_eq:
+        return estimate_ssa_cost(op, input_size / 2);
+    case SSA_multi_lt:
+    case SSA_multi_lte:
+    case SSA_branch_lt:
+    case SSA_branch_lte:
+        return estimate_ssa_cost(op, input_size > 2 ? (input_size - 2) / 2 : 0);
+
+    // Only the value being written counts:
+    case SSA_write_array8:
+    case SSA_write_array16:
+    case SSA_write_array16_b:
+        return estimate_ssa_cost(op, input_width(3));
+    case SSA_write_ptr:
+    case SSA_write_ptr_hw:
+        return estimate_ssa_cost(op, input_width(4));
+
+    case SSA_fill_array:
+    case SSA_init_array:
+    case SSA_read_array8:
+    case SSA_read_array16:
+    case SSA_read_array16_b:
+    case SSA_cg_read_array8_direct:
+    case SSA_read_ptr:
+    case SSA_read_ptr_hw:
+        return estimate_ssa_cost(op, ssa_node.type().size_of());
+
+    default:
+        break;
+    }
+
+    unsigned width = ssa_node.type().size_of();
+    bool const_operand = false;
+    for(unsigned i = 0; i < input_size; ++i)
+    {
+        ssa_value_t const input = ssa_node.input(i);
+        width = std::max<unsigned>(width, input.type().size_of());
+        const_operand |= i < 2 && input.is_num();
+    }
+
+    return estimate_ssa_cost(op, width, const_operand);
+}
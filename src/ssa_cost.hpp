@@ -0,0 +1,43 @@
+#ifndef SSA_COST_HPP
+#define SSA_COST_HPP
+
+// Estimates the code 'cg_isel' will generate for SSA nodes,
+// letting optimization passes compare alternatives without running isel.
+//
+// Estimates are built from the same instruction timings isel uses.
+// Each node is assumed to receive its first operand in A and to leave its
+// result in A, as isel does when nodes are chained together.
+// Other operands are read from memory, or as immediates when constant.
+
+#include "asm.hpp"
+#include "ir_decl.hpp"
+#include "ssa_op.hpp"
+
+struct ssa_cost_t
+{
+    unsigned cycles = 0;
+    unsigned bytes = 0;
+
+    // Weighs cycles against bytes the same way 'cg_isel' does.
+    constexpr unsigned long long weight() const { return cycles * 256ull + bytes * 4ull; }
+
+    constexpr ssa_cost_t& operator+=(ssa_cost_t o) { cycles += o.cycles; bytes += o.bytes; return *this; }
+    constexpr ssa_cost_t operator+(ssa_cost_t o) const { return o += *this; }
+    constexpr ssa_cost_t operator*(unsigned n) const { return { cycles * n, bytes * n }; }
+};
+
+constexpr ssa_cost_t op_cost(op_t op) { return { op_cycles(op), op_size(op) }; }
+
+// Estimates 'op' operating on values 'width' bytes wide.
+ssa_cost_t estimate_ssa_cost(ssa_op_t op, unsigned width, bool const_operand = false);
+
+// Estimates an 8-bit multiply, calling either of the runtime's routines.
+ssa_cost_t estimate_mul8_cost(bool mul_table);
+
+// Estimates a shift of a 'width'-byte value by a constant amount.
+ssa_cost_t estimate_shift_cost(unsigned width, unsigned amount);
+
+// Estimates an existing node, accounting for its types and constant inputs.
+ssa_cost_t estimate_ssa_cost(ssa_node_t const& ssa_node);
+
+#endif
@@ -117,6 +117,15 @@ public:
     static std::size_t array_size() { return allocated_size(); }
     static bool empty() { return allocated_size() == 0; }
 
+    // Frees the storage, which 'clear' keeps around.
+    static void release()
+    {
+        if(!empty())
+            return;
+        storage().reset();
+        bytes_capacity() = 0;
+    }
+
     template<typename T>
     struct scope_guard_t 
     { 
@@ -177,14 +186,16 @@ private:
     static auto& pool_ptr() { return _pool_ptr; }
 #endif
 public:
-    static void init() { pool_ptr() = &pool(); (void)pool().data(); }
+    static void init() { pool_ptr() = &pool(); }
     static handle_t alloc() { return { pool().alloc().id }; }
     static void free(handle_t h) { pool().free({ h.id }); }
     static void clear() { pool().clear(); }
+    static void release() { pool().release(); }
 
     static std::size_t size() { return pool().size(); }
     static std::size_t array_size() { return pool().array_size(); }
-    static T* data() { return pool().data(); }
+    static std::size_t array_size_after(std::size_t n) { return pool().array_size_after(n); }
+    static handle_t handle(T const* ptr) { return { pool().handle(ptr).id }; }
 };
 
 #endif
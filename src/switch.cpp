@@ -1,8 +1,12 @@
 #include "switch.hpp"
 
+#include <algorithm>
+
+#include <boost/container/small_vector.hpp>
 #include <boost/container/static_vector.hpp>
 
 #include "ir.hpp"
+#include "ssa_cost.hpp"
 
 namespace bc = ::boost::container;
 
@@ -37,62 +41,272 @@ bool switch_partial_to_full(ssa_node_t& switch_node)
     return true;
 }
 
-bool switch_partial_to_full(ir_t& ir)
+namespace // anonymous
+{
+
+// Describes the jump table of a switch.
+struct rep_t
+{
+    std::uint16_t rshift;
+    std::uint8_t common;
+    std::uint8_t start;
+    std::uint16_t size;
+    std::uint16_t popcount;
+};
+
+rep_t calc_rep(static_bitset_t<256> const& cases)
+{
+    if(cases.all_clear())
+        return rep_t{};
+
+    rep_t result = {};
+
+    // For rshift, common:
+    std::uint8_t common_mismatch = 0;
+    std::uint8_t const common_bits = cases.lowest_bit_set();
+
+    // For start, size:
+    int prev = cases.highest_bit_set() - 256;
+    std::uint8_t start = cases.lowest_bit_set();
+    std::uint8_t max_span = 0;
+
+    cases.for_each([&](std::uint8_t c)
+    { 
+        // For rshift, common:
+        common_mismatch |= c ^ common_bits;
+
+        // For start, size:
+        std::uint8_t const span = c - prev;
+        if(span > max_span)
+        {
+            max_span = span;
+            start = c;
+        }
+        prev = c;
+    });
+
+    if(common_mismatch)
+    {
+        result.rshift = builtin::ctz(common_mismatch);
+        result.common = common_bits & ~common_mismatch;
+    }
+
+    result.start = start;
+    result.size = 256 - std::uint8_t(max_span - 1);
+    result.popcount = cases.popcount();
+
+    return result;
+}
+
+// Estimates dispatching through the jump table 'switch_partial_to_full' builds.
+ssa_cost_t table_cost(rep_t const& rep)
+{
+    ssa_cost_t const bounds = estimate_ssa_cost(SSA_sub, 1, true) + estimate_ssa_cost(SSA_lt, 1, true) + estimate_ssa_cost(SSA_if, 0);
+    ssa_cost_t const shift = estimate_ssa_cost(SSA_ror, 1) + estimate_ssa_cost(SSA_if, 0);
+    unsigned const entries = (rep.size + (1 << rep.rshift) - 1) >> rep.rshift;
+    return bounds + shift * rep.rshift + estimate_ssa_cost(SSA_switch_full, 0) + ssa_cost_t{ 0, entries * 2 };
+}
+
+enum switch_lowering_t : std::uint8_t
+{
+    LOWER_NONE,
+    LOWER_TABLE, // A jump table, i.e. a smaller 'SSA_switch_partial'.
+    LOWER_SPLIT, // Compare against a pivot case, then lower each side.
+    LOWER_CASE,  // Compare against the only case.
+};
+
+struct switch_plan_t
+{
+    switch_lowering_t lowering = LOWER_NONE;
+    unsigned split = 0; // Index of the pivot case, for LOWER_SPLIT.
+    ssa_cost_t cost = {}; // 'cycles' is the worst-case dispatch time.
+};
+
+// Picks the cheapest lowering of each range of sorted case values.
+class switch_planner_t
+{
+public:
+    switch_planner_t(std::uint8_t const* values, unsigned size, unsigned cycle_bytes)
+    : m_values(values)
+    , m_size(size)
+    , m_cycle_bytes(cycle_bytes)
+    , m_plans(size * size)
+    {}
+
+    // Plans the cases in the range [begin, end).
+    switch_plan_t const& plan(unsigned begin, unsigned end)
+    {
+        assert(begin < end && end <= m_size);
+        switch_plan_t& plan = m_plans[begin * m_size + end - 1];
+        if(plan.lowering != LOWER_NONE)
+            return plan;
+
+        if(end - begin == 1)
+        {
+            plan = { LOWER_CASE, 0, estimate_ssa_cost(SSA_eq, 1, true) + estimate_ssa_cost(SSA_if, 0) };
+            return plan;
+        }
+
+        static_bitset_t<256> cases = {};
+        for(unsigned i = begin; i < end; ++i)
+            cases.set(m_values[i]);
+        plan = { LOWER_TABLE, 0, table_cost(calc_rep(cases)) };
+
+        // Try splitting in the middle, balancing the tree,
+        // and at the largest gap between cases, leaving dense runs together.
+        unsigned gap = begin + 1;
+        for(unsigned i = begin + 2; i < end; ++i)
+            if(m_values[i] - m_values[i-1] > m_values[gap] - m_values[gap-1])
+                gap = i;
+
+        try_split(plan, begin, (begin + end) / 2, end);
+        if(gap != (begin + end) / 2)
+            try_split(plan, begin, gap, end);
+
+        return plan;
+    }
+
+private:
+    unsigned long long score(ssa_cost_t cost) const { return cost.cycles * m_cycle_bytes + cost.bytes; }
+
+    void try_split(switch_plan_t& plan, unsigned begin, unsigned split, unsigned end)
+    {
+        ssa_cost_t const lo = this->plan(begin, split).cost;
+        ssa_cost_t const hi = this->plan(split, end).cost;
+        ssa_cost_t const compare = estimate_ssa_cost(SSA_lt, 1, true) + estimate_ssa_cost(SSA_if, 0);
+        ssa_cost_t const cost = { compare.cycles + std::max(lo.cycles, hi.cycles), compare.bytes + lo.bytes + hi.bytes };
+
+        if(score(cost) < score(plan.cost))
+            plan = { LOWER_SPLIT, split, cost };
+    }
+
+    std::uint8_t const* m_values;
+    unsigned m_size;
+    unsigned m_cycle_bytes;
+    std::vector<switch_plan_t> m_plans;
+};
+
+// Lowers sparse switches into trees of comparisons.
+// The leaves are single cases, or smaller switches that become jump tables.
+bool split_sparse_switches(ir_t& ir, heat_t heat)
 {
     bool updated = false;
 
-    struct rep_t
+    struct case_t
     {
-        std::uint16_t rshift;
-        std::uint8_t common;
-        std::uint8_t start;
-        std::uint16_t size;
-        std::uint16_t popcount;
+        std::uint8_t value;
+        std::uint8_t output;
     };
 
-    auto calc_rep = [](static_bitset_t<256> const& cases)
+    bc::small_vector<case_t, 16> cases;
+    bc::small_vector<std::uint8_t, 16> values;
+
+    for(cfg_ht cfg_it = ir.cfg_begin(); cfg_it; ++cfg_it)
     {
-        if(cases.all_clear())
-            return rep_t{};
+        ssa_ht const branch = cfg_it->last_daisy();
 
-        rep_t result = {};
+        if(!branch || branch->op() != SSA_switch_partial || branch->input_size() <= 2)
+            continue;
 
-        // For rshift, common:
-        std::uint8_t common_mismatch = 0;
-        std::uint8_t const common_bits = cases.lowest_bit_set();
+        // Sort the cases by value, remembering which output each takes.
+        // (Output 0 is the default case, with the rest matching inputs.)
+        unsigned const input_size = branch->input_size();
+        cases.clear();
+        for(unsigned i = 1; i < input_size; ++i)
+            cases.push_back({ std::uint8_t(branch->input(i).whole()), std::uint8_t(i) });
+        std::sort(cases.begin(), cases.end(), [](case_t a, case_t b) { return a.value < b.value; });
 
-        // For start, size:
-        int prev = cases.highest_bit_set() - 256;
-        std::uint8_t start = cases.lowest_bit_set();
-        std::uint8_t max_span = 0;
-
-        cases.for_each([&](std::uint8_t c)
-        { 
-            // For rshift, common:
-            common_mismatch |= c ^ common_bits;
-
-            // For start, size:
-            std::uint8_t const span = c - prev;
-            if(span > max_span)
+        values.clear();
+        for(case_t c : cases)
+            values.push_back(c.value);
+
+        switch_planner_t planner(values.data(), values.size(), heat_cycle_bytes(heat));
+        if(planner.plan(0, values.size()).lowering == LOWER_TABLE)
+            continue; // The existing switch is fine.
+
+        ssa_value_t condition = branch->input(0);
+        if(condition.type() != TYPE_U)
+            condition = cfg_it->emplace_ssa(SSA_cast, TYPE_U, condition);
+
+        auto const link_output = [&](cfg_ht from, unsigned output)
+        {
+            from->link_append_output(cfg_it->output(output), [&](ssa_ht phi)
             {
-                max_span = span;
-                start = c;
-            }
-            prev = c;
-        });
+                return phi->input(cfg_it->output_edge(output).index);
+            });
+        };
 
-        if(common_mismatch)
+        auto const link_tree = [&](cfg_ht from, cfg_ht to)
         {
-            result.rshift = builtin::ctz(common_mismatch);
-            result.common = common_bits & ~common_mismatch;
-        }
+            from->link_append_output(to, [](ssa_ht) { assert(false); return ssa_value_t(); });
+        };
+
+        auto const build = [&](auto const& build, unsigned begin, unsigned end) -> cfg_ht
+        {
+            switch_plan_t const plan = planner.plan(begin, end);
+            cfg_ht const cfg = ir.emplace_cfg(cfg_it->prop_flags());
+
+            switch(plan.lowering)
+            {
+            case LOWER_CASE:
+                {
+                    ssa_ht const eq = cfg->emplace_ssa(SSA_eq, TYPE_BOOL, condition, ssa_value_t(cases[begin].value, TYPE_U));
+                    ssa_ht const if_ = cfg->emplace_ssa(SSA_if, TYPE_VOID, eq);
+                    if_->append_daisy();
+                    link_output(cfg, 0);
+                    link_output(cfg, cases[begin].output);
+                }
+                break;
+
+            case LOWER_SPLIT:
+                {
+                    ssa_ht const lt = cfg->emplace_ssa(SSA_lt, TYPE_BOOL, condition, ssa_value_t(cases[plan.split].value, TYPE_U));
+                    ssa_ht const if_ = cfg->emplace_ssa(SSA_if, TYPE_VOID, lt);
+                    if_->append_daisy();
+                    link_tree(cfg, build(build, plan.split, end));
+                    link_tree(cfg, build(build, begin, plan.split));
+                }
+                break;
+
+            case LOWER_TABLE:
+                {
+                    ssa_ht const switch_ssa = cfg->emplace_ssa(SSA_switch_partial, TYPE_VOID, condition);
+                    switch_ssa->append_daisy();
+                    link_output(cfg, 0);
+                    for(unsigned i = begin; i < end; ++i)
+                    {
+                        switch_ssa->link_append_input(ssa_value_t(cases[i].value, TYPE_U));
+                        link_output(cfg, cases[i].output);
+                    }
+                }
+                break;
+
+            default:
+                assert(false);
+            }
 
-        result.start = start;
-        result.size = 256 - std::uint8_t(max_span - 1);
-        result.popcount = cases.popcount();
+            return cfg;
+        };
 
-        return result;
-    };
+        cfg_ht const root = build(build, 0, values.size());
+
+        // Replace the original switch with the tree:
+        branch->prune();
+        cfg_it->link_clear_outputs();
+        link_tree(cfg_it, root);
+
+        ir.assert_valid();
+        updated = true;
+    }
+
+    return updated;
+}
+
+} // end anonymous namespace
+
+bool switch_partial_to_full(ir_t& ir, heat_t heat)
+{
+    bool updated = split_sparse_switches(ir, heat);
 
     for(cfg_ht cfg_it = ir.cfg_begin(); cfg_it; ++cfg_it)
     {
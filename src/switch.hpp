@@ -7,6 +7,7 @@
 
 #include "ir_decl.hpp"
 #include "locator.hpp"
+#include "profile.hpp"
 
 class ir_t;
 class ssa_node_t;
@@ -17,8 +18,10 @@ class ssa_node_t;
 bool switch_partial_to_full(ssa_node_t& switch_node);
 
 // Converts every SSA_switch_partial node to SSA_switch_full.
+// Sparse switches are first split into trees of comparisons,
+// with 'heat' deciding how much space to trade for speed.
 // Return 'true' if any node updated.
-bool switch_partial_to_full(ir_t& ir);
+bool switch_partial_to_full(ir_t& ir, heat_t heat);
 
 using switch_table_t = std::vector<locator_t>;
 
@@ -1,5 +1,6 @@
 #include "text.hpp"
 
+#include <atomic>
 #include <charconv>
 
 #include "compiler_error.hpp"
@@ -8,6 +9,8 @@
 #include "rom.hpp"
 #include "hex.hpp"
 #include "assert.hpp"
+#include "options.hpp"
+#include "thread.hpp"
 
 string_literal_manager_t sl_manager;
 
@@ -270,26 +273,56 @@ std::pair<ct_array_t, unsigned> string_literal_manager_t::get_byte_pairs(global_
     return { std::move(array), 1 };
 }
 
-// Single-threaded
+// Calls 'fn' on every charmap, spreading the charmaps across threads.
+// Each charmap's strings are independent of the others, so no locking is needed.
+template<typename Fn>
+void string_literal_manager_t::for_each_charmap(Fn const& fn)
+{
+    std::vector<std::pair<global_t const*, charmap_info_t*>> jobs;
+    jobs.reserve(m_map.size());
+    for(auto& i : m_map)
+        jobs.emplace_back(i.first, &i.second);
+
+    if(jobs.empty())
+        return;
+
+    unsigned const num_threads = std::clamp<unsigned>(compiler_options().num_threads, 1, jobs.size());
+    std::atomic<unsigned> next_job = 0;
+
+    parallelize(num_threads,
+    [&](std::atomic<bool>& exception_thrown)
+    {
+        unsigned job;
+        while(!exception_thrown && (job = next_job++) < jobs.size())
+            fn(*jobs[job].first, *jobs[job].second);
+    },
+    []{});
+}
+
+// This function isn't thread-safe.
+// Call from a single thread only.
 void string_literal_manager_t::convert_all()
 {
     assert(compiler_phase() == PHASE_CONVERT_STRINGS);
 
-    for(auto& i : m_map)
+    for_each_charmap([this](global_t const& global, charmap_info_t& info)
     {
-        if(i.first->gclass() != GLOBAL_CHARMAP)
-            compiler_error(i.first->pstring(), fmt("% is not a charmap.", i.first->name));
-        convert(i.first->impl<charmap_t>(), i.second);
-    }
+        if(global.gclass() != GLOBAL_CHARMAP)
+            compiler_error(global.pstring(), fmt("% is not a charmap.", global.name));
+        convert(global.impl<charmap_t>(), info);
+    });
 }
 
-// Single-threaded
+// This function isn't thread-safe.
+// Call from a single thread only.
 void string_literal_manager_t::compress_all()
 {
     assert(compiler_phase() == PHASE_COMPRESS_STRINGS);
 
-    for(auto& i : m_map)
-        compress(i.first->impl<charmap_t>(), i.second);
+    for_each_charmap([this](global_t const& global, charmap_info_t& info)
+    {
+        compress(global.impl<charmap_t>(), info);
+    });
 }
 
 void string_literal_manager_t::convert(charmap_t const& charmap, charmap_info_t& info)
@@ -381,14 +414,22 @@ void string_literal_manager_t::compress(charmap_t const& charmap, charmap_info_t
         if(pair_map.empty())
             break;
 
+        // Ties go to the lowest pair, as the map's order depends on the order strings were parsed.
         rh::apair<byte_pair_t, unsigned> const* most_common = nullptr;
         auto it = pair_map.begin();
         for(; it != pair_map.end(); ++it)
             if(pair_depth(it->first) < MAX_DEPTH)
                 goto new_most_common;
         for(; it != pair_map.end(); ++it)
-            if(it->second > most_common->second && pair_depth(it->first) < MAX_DEPTH)
+        {
+            if(pair_depth(it->first) >= MAX_DEPTH)
+                continue;
+            if(it->second > most_common->second 
+               || (it->second == most_common->second && it->first < most_common->first))
+            {
                 new_most_common: most_common = &*it;
+            }
+        }
 
         // No point in replacing if it hardly occurs:
         if(!most_common || most_common->second <= 2)
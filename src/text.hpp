@@ -68,10 +68,13 @@ private:
         std::vector<byte_pair_t> byte_pairs;
     };
 
+    template<typename Fn>
+    void for_each_charmap(Fn const& fn);
+
     void convert(charmap_t const& charmap, charmap_info_t& info);
     void compress(charmap_t const& charmap, charmap_info_t& info);
 
-    std::mutex mutex;
+    std::mutex mutex; // Protects 'm_map' during parsing.
     rh::joker_map<global_t const*, charmap_info_t> m_map;
 };
 
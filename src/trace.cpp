@@ -0,0 +1,247 @@
+#include "trace.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "json.hpp"
+
+#include "format.hpp"
+#include "globals.hpp"
+#include "ir.hpp"
+#include "lt.hpp"
+#include "phase.hpp"
+#include "thread.hpp"
+
+namespace
+{
+
+using trace_clock_t = std::chrono::steady_clock;
+
+trace_clock_t::time_point const epoch = trace_clock_t::now();
+
+struct event_t
+{
+    char ph; // 'X' for spans, 'C' for counters.
+    char const* category;
+    std::string name;
+    unsigned tid;
+    long long ts; // In microseconds since 'epoch'.
+    long long dur;
+    std::vector<std::pair<char const*, std::size_t>> args;
+};
+
+std::mutex events_mutex;
+std::vector<event_t> events;
+
+long long micros(trace_clock_t::time_point t)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(t - epoch).count();
+}
+
+// Small ids are nicer to read than 'std::thread::id'.
+// The main thread is always the first to record something, getting id 0.
+unsigned thread_id()
+{
+    static std::atomic<unsigned> next_id = 0;
+    static TLS unsigned id = next_id++;
+    return id;
+}
+
+void record(event_t&& event)
+{
+    std::lock_guard<std::mutex> lock(events_mutex);
+    events.push_back(std::move(event));
+}
+
+void record_span(char const* category, std::string name, trace_clock_t::time_point start, trace_clock_t::time_point end)
+{
+    record({ 'X', category, std::move(name), thread_id(), micros(start), micros(end) - micros(start) });
+}
+
+char const* phase_name(compiler_phase_t phase)
+{
+    static char const* const names[] =
+    {
+        "none",
+        "init",
+        "parse macros",
+        "parse",
+        "parse cleanup",
+        "count members",
+        "group members",
+        "finish members",
+        "runtime",
+        "charmap groups",
+        "convert strings",
+        "compress strings",
+        "order resolve",
+        "resolve",
+        "order precheck",
+        "precheck",
+        "order compile",
+        "compile",
+        "alloc ram",
+        "reset proc",
+        "asm goto modes",
+        "initial values",
+        "prepare alloc rom",
+        "alloc rom",
+        "link",
+    };
+    static_assert(sizeof(names) / sizeof(*names) == PHASE_LINK + 1);
+    return names[phase];
+}
+
+// Records a span for each phase.
+struct phase_tracer_t : public on_phase_change_t
+{
+    virtual void on_change(compiler_phase_t from, compiler_phase_t to)
+    {
+        if(!tracing())
+            return;
+
+        auto const now = trace_clock_t::now();
+        record_span("phase", phase_name(from), start, now);
+        start = now;
+        trace_memory();
+    }
+
+    trace_clock_t::time_point start = epoch;
+};
+
+phase_tracer_t phase_tracer;
+
+// Reads a line like "VmRSS: 1234 kB" from '/proc/self/status'.
+unsigned long read_status_kib(char const* format)
+{
+    unsigned long kib = 0;
+#ifdef __linux__
+    if(std::FILE* fp = std::fopen("/proc/self/status", "r"))
+    {
+        char line[256];
+        while(std::fgets(line, sizeof(line), fp))
+            if(std::sscanf(line, format, &kib) == 1)
+                break;
+        std::fclose(fp);
+    }
+#endif
+    return kib;
+}
+
+template<typename Handle>
+std::size_t handle_pool_size()
+{
+    return Handle::with_const_pool([](auto const& pool) { return pool.size(); });
+}
+
+} // end anonymous namespace
+
+trace_span_t::trace_span_t(char const* category, std::string const& name)
+{
+    if(!tracing())
+        return;
+
+    m_category = category;
+    m_name = name;
+    m_start = trace_clock_t::now();
+}
+
+trace_span_t::~trace_span_t()
+{
+    if(m_category)
+        record_span(m_category, std::move(m_name), m_start, trace_clock_t::now());
+}
+
+void trace_memory()
+{
+    if(!tracing())
+        return;
+
+    long long const ts = micros(trace_clock_t::now());
+    unsigned const tid = thread_id();
+
+    record({ 'C', "memory", "resident KiB", tid, ts, 0, {{ "KiB", rss_kib() }} });
+
+    record({ 'C', "memory", "handle pools", tid, ts, 0,
+    {
+        { "globals", handle_pool_size<global_ht>() },
+        { "fns", handle_pool_size<fn_ht>() },
+        { "gvars", handle_pool_size<gvar_ht>() },
+        { "consts", handle_pool_size<const_ht>() },
+        { "gmembers", handle_pool_size<gmember_ht>() },
+        { "lts", handle_pool_size<lt_ht>() },
+    }});
+
+    // Each thread has its own IR pools:
+    record({ 'C', "memory", fmt("IR pools (thread %)", tid), tid, ts, 0,
+    {
+        { "ssa", ssa_pool::size() },
+        { "cfg", cfg_pool::size() },
+    }});
+}
+
+// This function isn't thread-safe.
+// Call from a single thread only.
+void write_trace(std::string const& filename)
+{
+    // End the current phase:
+    record_span("phase", phase_name(compiler_phase()), phase_tracer.start, trace_clock_t::now());
+
+    using json = nlohmann::json;
+
+    json trace_events = json::array();
+    trace_events.push_back({ { "ph", "M" }, { "name", "thread_name" }, { "pid", 1 }, { "tid", 0 },
+                             { "args", { { "name", "main" } } } });
+
+    for(event_t const& event : events)
+    {
+        json e = { { "ph", std::string(1, event.ph) }, { "name", event.name }, { "pid", 1 },
+                   { "tid", event.tid }, { "ts", event.ts } };
+
+        if(event.ph == 'X')
+        {
+            e["cat"] = event.category;
+            e["dur"] = event.dur;
+        }
+        else
+        {
+            json args = json::object();
+            for(auto const& arg : event.args)
+                args[arg.first] = arg.second;
+            e["args"] = std::move(args);
+        }
+
+        trace_events.push_back(std::move(e));
+    }
+
+    std::ofstream of(filename);
+    if(!of)
+        throw std::runtime_error(fmt("Unable to write trace file %", filename));
+    of << json({ { "traceEvents", std::move(trace_events) }, { "displayTimeUnit", "ms" } });
+}
+
+unsigned long rss_kib()
+{
+    return read_status_kib("VmRSS: %lu kB");
+}
+
+unsigned long peak_rss_kib()
+{
+    unsigned long const peak = read_status_kib("VmHWM: %lu kB");
+
+#ifdef __linux__
+    // Reset the peak, so the next call only measures what follows.
+    if(std::FILE* fp = std::fopen("/proc/self/clear_refs", "w"))
+    {
+        std::fputs("5", fp);
+        std::fclose(fp);
+    }
+#endif
+
+    return peak;
+}
@@ -0,0 +1,48 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+// Records what the compiler spends its time and memory on, for performance analysis.
+// (Enabled by --trace.)
+// The output is Chrome's trace event JSON format,
+// which can be loaded into 'chrome://tracing' or Perfetto.
+//
+// Spans are recorded per thread, showing how busy each thread was.
+// Compiler phases are recorded automatically.
+
+#include <chrono>
+#include <string>
+
+#include "options.hpp"
+
+inline bool tracing() { return !compiler_options().raw_trace.empty(); }
+
+// Records a span of work, lasting the lifetime of this object.
+class trace_span_t
+{
+public:
+    // 'category' must point to a string literal.
+    trace_span_t(char const* category, std::string const& name);
+    ~trace_span_t();
+
+    trace_span_t(trace_span_t const&) = delete;
+    trace_span_t& operator=(trace_span_t const&) = delete;
+private:
+    char const* m_category = nullptr;
+    std::string m_name;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Records the current memory use:
+// resident memory, handle pool sizes, and the calling thread's IR pool sizes.
+void trace_memory();
+
+// Writes everything recorded so far.
+void write_trace(std::string const& filename);
+
+// Returns the resident memory in KiB, or 0 if unknown.
+unsigned long rss_kib();
+
+// Returns the peak resident memory since the last call, in KiB, or 0 if unknown.
+unsigned long peak_rss_kib();
+
+#endif